@@ -0,0 +1,1133 @@
+#include "bitgrid.h"
+#include "life.h"
+#include "cycle.h"
+#include "rule.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__GNUC__) && defined(__x86_64__)
+    #define HAVE_AVX2
+    #include <immintrin.h>
+#endif
+#define WORD_BITS 64
+#define ALIGNMENT 32
+#define TILE_ROWS 32
+#define TILE_WORDS 4
+// A block of tiles advanced several generations at a time.
+#define BLOCK_TILES 2
+#define BLOCK_ROWS (BLOCK_TILES * TILE_ROWS)
+#define BLOCK_WORDS (BLOCK_TILES * TILE_WORDS)
+
+struct step_job {
+    struct bitgrid *b;
+    struct workers *w;
+    long n;
+    bool until_stable;
+    // Cells changed by each worker and the changes to the hash, for two
+    // generations in turn.
+    long *changed;
+    uint64_t *hashes;
+    long generations, last_changed;
+};
+
+/* A worker's copy of a block with its halo, in two generations. */
+struct block_buffer {
+    uint64_t *cells, *next;
+    // Bits of each word that are in the grid, and whether each row is.
+    uint64_t *inside;
+    bool *row_inside;
+    // Cells changed in each generation of a round, and in each tile.
+    long changed[BITGRID_MAX_BLOCK];
+    uint64_t tiles[BLOCK_TILES][BLOCK_TILES];
+};
+
+struct block_job {
+    struct bitgrid *b;
+    struct workers *w;
+    long n;
+    bool until_stable;
+    struct block_buffer *buffers;
+    // Cells changed by each worker in each generation of a round and the
+    // changes to the hash, for two rounds in turn.
+    long *changed;
+    uint64_t *hashes;
+    long generations, last_changed;
+};
+
+static inline uint64_t*
+row_ptr(const uint64_t *cells, const struct bitgrid *b, int y) {
+    return (uint64_t*) cells + (size_t) (y + 1) * b->stride + 1;
+}
+
+static inline uint64_t
+left_neighbors(const uint64_t *p, int w) {
+    return (p[w] << 1) | (p[w - 1] >> (WORD_BITS - 1));
+}
+
+static inline uint64_t
+right_neighbors(const uint64_t *p, int w) {
+    return (p[w] >> 1) | (p[w + 1] << (WORD_BITS - 1));
+}
+
+static void
+step_words(const uint64_t *up, const uint64_t *row, const uint64_t *down,
+           uint64_t *out, int from, int to) {
+    for (int w = from; w < to; w++) {
+        out[w] = life_word(
+            left_neighbors(up, w), up[w], right_neighbors(up, w),
+            left_neighbors(row, w), row[w], right_neighbors(row, w),
+            left_neighbors(down, w), down[w], right_neighbors(down, w));
+    }
+}
+
+static void
+step_row_scalar(const uint64_t *up, const uint64_t *row, const uint64_t *down,
+                uint64_t *out, int words, struct rule rule) {
+    step_words(up, row, down, out, 0, words);
+}
+
+LIFE_INLINE void
+step_rule_words(uint16_t birth, uint16_t survival, const uint64_t *up,
+                const uint64_t *row, const uint64_t *down, uint64_t *out,
+                int from, int to) {
+    for (int w = from; w < to; w++) {
+        out[w] = life_rule_word(birth, survival,
+            left_neighbors(up, w), up[w], right_neighbors(up, w),
+            left_neighbors(row, w), row[w], right_neighbors(row, w),
+            left_neighbors(down, w), down[w], right_neighbors(down, w));
+    }
+}
+
+/* Steps any rule, looking its tables up from the rule at run time. */
+static void
+step_row_rule(const uint64_t *up, const uint64_t *row, const uint64_t *down,
+              uint64_t *out, int words, struct rule rule) {
+    step_rule_words(rule.birth, rule.survival, up, row, down, out, 0, words);
+}
+
+#ifdef HAVE_AVX2
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256i
+load(const uint64_t *p) {
+    return _mm256_loadu_si256((const __m256i*) p);
+}
+
+static inline AVX2 __m256i
+left_neighbors_avx2(const uint64_t *p, int w) {
+    return _mm256_or_si256(_mm256_slli_epi64(load(p + w), 1),
+        _mm256_srli_epi64(load(p + w - 1), WORD_BITS - 1));
+}
+
+static inline AVX2 __m256i
+right_neighbors_avx2(const uint64_t *p, int w) {
+    return _mm256_or_si256(_mm256_srli_epi64(load(p + w), 1),
+        _mm256_slli_epi64(load(p + w + 1), WORD_BITS - 1));
+}
+
+/* Full adder of three bit vectors. */
+static inline AVX2 void
+add3_avx2(__m256i a, __m256i b, __m256i c, __m256i *ones, __m256i *twos) {
+    __m256i a_xor_b = _mm256_xor_si256(a, b);
+    *ones = _mm256_xor_si256(a_xor_b, c);
+    *twos = _mm256_or_si256(_mm256_and_si256(a, b),
+                            _mm256_and_si256(c, a_xor_b));
+}
+
+/* Same as step_row_scalar(), but four words at a time. */
+static AVX2 void
+step_row_avx2(const uint64_t *up, const uint64_t *row, const uint64_t *down,
+              uint64_t *out, int words, struct rule rule) {
+    int w = 0;
+    for (; w + 4 <= words; w += 4) {
+        __m256i u_ones, u_twos, d_ones, d_twos, ones, carry;
+        add3_avx2(left_neighbors_avx2(up, w), load(up + w),
+            right_neighbors_avx2(up, w), &u_ones, &u_twos);
+        add3_avx2(left_neighbors_avx2(down, w), load(down + w),
+            right_neighbors_avx2(down, w), &d_ones, &d_twos);
+        __m256i l = left_neighbors_avx2(row, w),
+                r = right_neighbors_avx2(row, w);
+        __m256i m_ones = _mm256_xor_si256(l, r),
+                m_twos = _mm256_and_si256(l, r);
+        add3_avx2(u_ones, d_ones, m_ones, &ones, &carry);
+
+        __m256i x = _mm256_xor_si256(u_twos, d_twos),
+                y = _mm256_xor_si256(m_twos, carry);
+        __m256i more = _mm256_or_si256(_mm256_and_si256(u_twos, d_twos),
+                                       _mm256_and_si256(m_twos, carry));
+        __m256i one_two = _mm256_andnot_si256(more, _mm256_xor_si256(x, y));
+        __m256i next = _mm256_and_si256(one_two,
+            _mm256_or_si256(ones, load(row + w)));
+        _mm256_storeu_si256((__m256i*) (out + w), next);
+    }
+    step_words(up, row, down, out, w, words);
+}
+
+LIFE_INLINE AVX2 __m256i
+select_avx2(__m256i s, __m256i a, __m256i b) {
+    return _mm256_xor_si256(a, _mm256_and_si256(_mm256_xor_si256(a, b), s));
+}
+
+/* Same as life_lookup(). */
+LIFE_INLINE AVX2 __m256i
+lookup_avx2(uint16_t table, __m256i ones, __m256i twos, __m256i fours,
+            __m256i eights) {
+    #define ENTRY(n) _mm256_set1_epi64x(-(long long) ((table >> (n)) & 1))
+    __m256i low = select_avx2(twos, select_avx2(ones, ENTRY(0), ENTRY(1)),
+        select_avx2(ones, ENTRY(2), ENTRY(3)));
+    __m256i high = select_avx2(twos, select_avx2(ones, ENTRY(4), ENTRY(5)),
+        select_avx2(ones, ENTRY(6), ENTRY(7)));
+    return select_avx2(eights, select_avx2(fours, low, high), ENTRY(8));
+    #undef ENTRY
+}
+
+/* Same as step_rule_words(), but four words at a time. */
+LIFE_INLINE AVX2 void
+step_rule_words_avx2(uint16_t birth, uint16_t survival, const uint64_t *up,
+                     const uint64_t *row, const uint64_t *down, uint64_t *out,
+                     int words) {
+    int w = 0;
+    for (; w + 4 <= words; w += 4) {
+        __m256i u_ones, u_twos, d_ones, d_twos, ones, carry;
+        add3_avx2(left_neighbors_avx2(up, w), load(up + w),
+            right_neighbors_avx2(up, w), &u_ones, &u_twos);
+        add3_avx2(left_neighbors_avx2(down, w), load(down + w),
+            right_neighbors_avx2(down, w), &d_ones, &d_twos);
+        __m256i l = left_neighbors_avx2(row, w),
+                r = right_neighbors_avx2(row, w);
+        __m256i m_ones = _mm256_xor_si256(l, r),
+                m_twos = _mm256_and_si256(l, r);
+        add3_avx2(u_ones, d_ones, m_ones, &ones, &carry);
+
+        __m256i t_ones, t_twos;
+        add3_avx2(u_twos, d_twos, m_twos, &t_ones, &t_twos);
+        __m256i twos = _mm256_xor_si256(t_ones, carry),
+                four_carry = _mm256_and_si256(t_ones, carry);
+        __m256i fours = _mm256_xor_si256(t_twos, four_carry),
+                eights = _mm256_and_si256(t_twos, four_carry);
+        __m256i next = select_avx2(load(row + w),
+            lookup_avx2(birth, ones, twos, fours, eights),
+            lookup_avx2(survival, ones, twos, fours, eights));
+        _mm256_storeu_si256((__m256i*) (out + w), next);
+    }
+    step_rule_words(birth, survival, up, row, down, out, w, words);
+}
+
+static AVX2 void
+step_row_rule_avx2(const uint64_t *up, const uint64_t *row,
+                   const uint64_t *down, uint64_t *out, int words,
+                   struct rule rule) {
+    step_rule_words_avx2(rule.birth, rule.survival, up, row, down, out,
+        words);
+}
+#endif
+
+#define SCALAR_KERNEL(name, birth, survival) \
+    static void \
+    step_row_##name(const uint64_t *up, const uint64_t *row, \
+                    const uint64_t *down, uint64_t *out, int words, \
+                    struct rule rule) { \
+        step_rule_words(birth, survival, up, row, down, out, 0, words); \
+    }
+RULE_NAMED(SCALAR_KERNEL)
+
+#ifdef HAVE_AVX2
+    #define AVX2_KERNEL(name, birth, survival) \
+        static AVX2 void \
+        step_row_##name##_avx2(const uint64_t *up, const uint64_t *row, \
+                               const uint64_t *down, uint64_t *out, \
+                               int words, struct rule rule) { \
+            step_rule_words_avx2(birth, survival, up, row, down, out, \
+                words); \
+        }
+    RULE_NAMED(AVX2_KERNEL)
+    #define WITH_AVX2(kernel) kernel
+#else
+    #define WITH_AVX2(kernel) NULL
+#endif
+#define KERNELS(name, birth, survival) \
+    { { birth, survival }, step_row_##name, WITH_AVX2(step_row_##name##_avx2) },
+
+// The last kernels are for the rules without kernels of their own.
+static const struct {
+    struct rule rule;
+    bitgrid_kernel scalar, avx2;
+} named_kernels[] = {
+    { { RULE_N(3), RULE_N(2) | RULE_N(3) }, step_row_scalar,
+        WITH_AVX2(step_row_avx2) },
+    RULE_NAMED(KERNELS)
+    { { 0, 0 }, step_row_rule, WITH_AVX2(step_row_rule_avx2) }
+};
+
+/* Picks the kernels of the rule, or the ones looking its tables up at run
+ * time if it has none, and the AVX2 one if the processor has AVX2. */
+static bitgrid_kernel
+select_row_kernel(struct rule rule) {
+    const size_t last = sizeof(named_kernels) / sizeof(*named_kernels) - 1;
+    size_t i = 0;
+    while (i < last && !rule_equal(rule, named_kernels[i].rule))
+        i++;
+    #ifdef HAVE_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return named_kernels[i].avx2;
+    #endif
+    return named_kernels[i].scalar;
+}
+
+static uint64_t*
+allocate_cells(const struct bitgrid *b) {
+    size_t size = sizeof(uint64_t) * b->stride * (b->rows + 2);
+    size = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    uint64_t *cells = aligned_alloc(ALIGNMENT, size);
+    if (cells)
+        memset(cells, 0, size);
+    return cells;
+}
+
+static inline int
+tile_index(const struct bitgrid *b, int tile_y, int tile_x) {
+    return (tile_y + 1) * b->tile_stride + tile_x + 1;
+}
+
+static bool
+allocate_tiles(struct bitgrid *b) {
+    b->tile_rows = (b->rows + TILE_ROWS - 1) / TILE_ROWS;
+    b->tile_columns = (b->words + TILE_WORDS - 1) / TILE_WORDS;
+    b->tile_stride = b->tile_columns + 2;
+    const size_t size = (size_t) b->tile_stride * (b->tile_rows + 2);
+    b->changed = calloc(size, 1);
+    b->next_changed = calloc(size, 1);
+    b->population = calloc(size, sizeof(*b->population));
+    if (!b->changed || !b->next_changed || !b->population)
+        return false;
+
+    // Nothing is known about the first generation.
+    for (int ty = 0; ty < b->tile_rows; ty++) {
+        for (int tx = 0; tx < b->tile_columns; tx++)
+            b->changed[tile_index(b, ty, tx)] = 1;
+    }
+    return true;
+}
+
+struct bitgrid*
+bitgrid_init(int rows, int columns, struct rule rule, bool torus) {
+    struct bitgrid *b = malloc(sizeof(*b));
+    if (!b)
+        return NULL;
+    memset(b, 0, sizeof(*b));
+
+    b->rule = rule;
+    b->kernel = select_row_kernel(rule);
+    b->torus = torus;
+    b->rows = rows;
+    b->columns = columns;
+    b->words = (columns + WORD_BITS - 1) / WORD_BITS;
+    b->stride = b->words + 2;
+    b->tail_mask = columns % WORD_BITS == 0 ? ~UINT64_C(0) :
+        (UINT64_C(1) << (columns % WORD_BITS)) - 1;
+
+    b->cells = allocate_cells(b);
+    b->next = allocate_cells(b);
+    if (!b->cells || !b->next || !allocate_tiles(b)) {
+        bitgrid_free(b);
+        return NULL;
+    }
+    return b;
+}
+
+static void
+free_block_buffers(struct block_buffer *buffers, int workers) {
+    if (!buffers)
+        return;
+    for (int i = 0; i < workers; i++) {
+        free(buffers[i].cells);
+        free(buffers[i].next);
+        free(buffers[i].inside);
+        free(buffers[i].row_inside);
+    }
+    free(buffers);
+}
+
+void
+bitgrid_free(struct bitgrid *b) {
+    if (!b)
+        return;
+    free(b->cells);
+    free(b->next);
+    free(b->changed);
+    free(b->next_changed);
+    free(b->population);
+    free_block_buffers(b->block_buffers, b->block_workers);
+    free(b->block_counts);
+    free(b);
+}
+
+bool
+bitgrid_get(const struct bitgrid *b, int y, int x) {
+    const uint64_t *row = row_ptr(b->cells, b, y);
+    return (row[x / WORD_BITS] >> (x % WORD_BITS)) & 1;
+}
+
+static inline uint64_t
+word_key(const struct bitgrid *b, int y, int w) {
+    return (uint64_t) y * b->words + w;
+}
+
+void
+bitgrid_set(struct bitgrid *b, int y, int x, bool alive) {
+    uint64_t *word = row_ptr(b->cells, b, y) + x / WORD_BITS;
+    const uint64_t old = *word, bit = UINT64_C(1) << (x % WORD_BITS);
+    if (alive)
+        *word |= bit;
+    else
+        *word &= ~bit;
+    b->population[tile_index(b, y / TILE_ROWS, x / WORD_BITS / TILE_WORDS)] +=
+        __builtin_popcountll(*word) - __builtin_popcountll(old);
+    if (b->hashing) {
+        const uint64_t key = word_key(b, y, x / WORD_BITS);
+        b->hash ^= cycle_word_hash(key, old) ^ cycle_word_hash(key, *word);
+    }
+    b->changed[tile_index(b, y / TILE_ROWS, x / WORD_BITS / TILE_WORDS)] = 1;
+}
+
+void
+bitgrid_flip(struct bitgrid *b, int y, int word, uint64_t flip) {
+    uint64_t *cells = row_ptr(b->cells, b, y) + word;
+    const uint64_t old = *cells;
+    *cells ^= flip;
+    const int tile = tile_index(b, y / TILE_ROWS, word / TILE_WORDS);
+    b->population[tile] += __builtin_popcountll(*cells) -
+        __builtin_popcountll(old);
+    if (b->hashing) {
+        const uint64_t key = word_key(b, y, word);
+        b->hash ^= cycle_word_hash(key, old) ^ cycle_word_hash(key, *cells);
+    }
+    b->changed[tile] = 1;
+}
+
+/* After a step, next holds the generation before in every tile that
+ * changed, and the same cells as the grid in every other one. */
+bool
+bitgrid_row_flips(const struct bitgrid *b, int y, uint64_t *flips) {
+    const uint8_t *changed = b->changed + tile_index(b, y / TILE_ROWS, 0);
+    const uint64_t *row = row_ptr(b->cells, b, y);
+    const uint64_t *before = row_ptr(b->next, b, y);
+    bool any = false;
+    for (int tx = 0; tx < b->tile_columns; tx++) {
+        const int first = tx * TILE_WORDS;
+        const int last = first + TILE_WORDS < b->words ? first + TILE_WORDS :
+                                                         b->words;
+        if (changed[tx]) {
+            for (int w = first; w < last; w++)
+                flips[w] = row[w] ^ before[w];
+            any = true;
+        }
+        else {
+            for (int w = first; w < last; w++)
+                flips[w] = 0;
+        }
+    }
+    // The ghost cell of a torus may be left in next.
+    flips[b->words - 1] &= b->tail_mask;
+    return any;
+}
+
+/* Steps a tile and counts its population. Unless hash is NULL, moves the
+ * words that changed in and out of it. */
+static long
+step_tile(const struct bitgrid *b, const uint64_t *cells, uint64_t *next,
+          int tile_y, int tile_x, uint64_t *hash) {
+    const int from = tile_y * TILE_ROWS;
+    const int to = from + TILE_ROWS < b->rows ? from + TILE_ROWS : b->rows;
+    const int first_word = tile_x * TILE_WORDS;
+    const bool last = first_word + TILE_WORDS >= b->words;
+    const int words = last ? b->words - first_word : TILE_WORDS;
+
+    long changed = 0;
+    uint32_t population = 0;
+    for (int y = from; y < to; y++) {
+        const uint64_t *row = row_ptr(cells, b, y) + first_word;
+        uint64_t *out = row_ptr(next, b, y) + first_word;
+        b->kernel(row - b->stride, row, row + b->stride, out, words,
+            b->rule);
+        // Cells past the last column must stay dead.
+        if (last)
+            out[words - 1] &= b->tail_mask;
+        for (int w = 0; w < words; w++) {
+            // Leaves out the ghost cell in the last word of a torus.
+            const uint64_t before = last && w == words - 1 ?
+                row[w] & b->tail_mask : row[w];
+            const uint64_t diff = before ^ out[w];
+            changed += __builtin_popcountll(diff);
+            population += __builtin_popcountll(out[w]);
+            if (hash && diff) {
+                const uint64_t key = word_key(b, y, first_word + w);
+                *hash ^= cycle_word_hash(key, before) ^
+                    cycle_word_hash(key, out[w]);
+            }
+        }
+    }
+    b->population[tile_index(b, tile_y, tile_x)] = population;
+    return changed;
+}
+
+static inline bool
+tile_is_active(const struct bitgrid *b, const uint8_t *changed, int tile_y,
+               int tile_x) {
+    const uint8_t *up = changed + tile_index(b, tile_y - 1, tile_x);
+    const uint8_t *row = up + b->tile_stride, *down = row + b->tile_stride;
+    return up[-1] | up[0] | up[1] | row[-1] | row[0] | row[1] |
+        down[-1] | down[0] | down[1];
+}
+
+/* Steps the tile rows from to to. A tile whose neighborhood didn't change in
+ * the last generation doesn't change in this one either, and then next
+ * already holds the same cells as the tile, so the tile can be skipped. */
+static long
+step_tiles(const struct bitgrid *b, const uint64_t *cells, uint64_t *next,
+           const uint8_t *changed, uint8_t *next_changed, int from, int to,
+           uint64_t *hash) {
+    long total = 0;
+    for (int ty = from; ty < to; ty++) {
+        for (int tx = 0; tx < b->tile_columns; tx++) {
+            long n = 0;
+            if (tile_is_active(b, changed, ty, tx))
+                n = step_tile(b, cells, next, ty, tx, hash);
+            next_changed[tile_index(b, ty, tx)] = n > 0;
+            total += n;
+        }
+    }
+    return total;
+}
+
+/* Copies the edges of a row into the ghost cells on the opposite side of
+ * the torus. */
+static inline void
+wrap_row(const struct bitgrid *b, uint64_t *row) {
+    const int last = b->columns - 1, end = b->columns % WORD_BITS;
+    row[-1] = (row[last / WORD_BITS] >> (last % WORD_BITS)) <<
+        (WORD_BITS - 1);
+    if (end == 0)
+        row[b->words] = row[0] & 1;
+    else {
+        row[b->words - 1] = (row[b->words - 1] & b->tail_mask) |
+            (row[0] & 1) << end;
+    }
+}
+
+/* Copies the edges of the rows from to to into the ghost cells on the
+ * opposite side of the torus, and the flags of their tiles into the border
+ * of the flags. The first and the last row are copied into the ghost rows
+ * too, with their ghost cells, by the worker that has them, unless the
+ * ghost rows are a halo. */
+static void
+fill_ghosts(const struct bitgrid *b, uint64_t *cells, uint8_t *tiles,
+            int tile_from, int tile_to) {
+    const int from = tile_from * TILE_ROWS;
+    const int to = tile_to * TILE_ROWS < b->rows ? tile_to * TILE_ROWS :
+                                                   b->rows;
+    for (int y = from; y < to; y++)
+        wrap_row(b, row_ptr(cells, b, y));
+    for (int ty = tile_from; ty < tile_to; ty++) {
+        tiles[tile_index(b, ty, -1)] = tiles[tile_index(b, ty,
+            b->tile_columns - 1)];
+        tiles[tile_index(b, ty, b->tile_columns)] = tiles[tile_index(b, ty,
+            0)];
+    }
+    if (b->halo)
+        return;
+
+    const size_t row_size = sizeof(*cells) * b->stride;
+    if (from == 0 && from < to) {
+        memcpy(row_ptr(cells, b, b->rows) - 1, row_ptr(cells, b, 0) - 1,
+            row_size);
+        memcpy(tiles + tile_index(b, b->tile_rows, -1),
+            tiles + tile_index(b, 0, -1), b->tile_stride);
+    }
+    if (to == b->rows && from < to) {
+        memcpy(row_ptr(cells, b, -1) - 1, row_ptr(cells, b, b->rows - 1) - 1,
+            row_size);
+        memcpy(tiles + tile_index(b, -1, -1),
+            tiles + tile_index(b, b->tile_rows - 1, -1), b->tile_stride);
+    }
+}
+
+static void
+clear_ghosts(const struct bitgrid *b, uint64_t *cells, int tile_from,
+             int tile_to) {
+    const int from = tile_from * TILE_ROWS;
+    const int to = tile_to * TILE_ROWS < b->rows ? tile_to * TILE_ROWS :
+                                                   b->rows;
+    for (int y = from; y < to; y++)
+        row_ptr(cells, b, y)[b->words - 1] &= b->tail_mask;
+}
+
+/* Stores a row of a halo into the ghost row at y, and flags the tiles of
+ * the border next to it that differ from the ghost row of the generation
+ * before, which is in next after a step. */
+static void
+set_ghost_row(struct bitgrid *b, int y, const uint64_t *words) {
+    uint64_t *row = row_ptr(b->cells, b, y);
+    const uint64_t *before = row_ptr(b->next, b, y);
+    if (words)
+        memcpy(row, words, sizeof(*row) * b->words);
+    else
+        memset(row, 0, sizeof(*row) * b->words);
+    row[b->words - 1] &= b->tail_mask;
+    row[-1] = row[b->words] = 0;
+    if (b->torus)
+        wrap_row(b, row);
+
+    uint8_t *tiles = b->changed + tile_index(b, y < 0 ? -1 : b->tile_rows, 0);
+    for (int tx = 0; tx < b->tile_columns; tx++) {
+        const int first = tx * TILE_WORDS;
+        const int last = first + TILE_WORDS < b->words ? first + TILE_WORDS :
+                                                         b->words;
+        uint64_t diff = 0;
+        for (int w = first; w < last; w++)
+            diff |= row[w] ^ before[w];
+        tiles[tx] = diff != 0;
+    }
+    tiles[-1] = b->torus ? tiles[b->tile_columns - 1] : 0;
+    tiles[b->tile_columns] = b->torus ? tiles[0] : 0;
+}
+
+void
+bitgrid_set_halo(struct bitgrid *b, const uint64_t *above,
+                 const uint64_t *below) {
+    b->halo = true;
+    set_ghost_row(b, -1, above);
+    set_ghost_row(b, b->rows, below);
+}
+
+/* Every worker steps its band of tile rows and waits for the others once per
+ * generation. All of them sum the same counts, so they agree on when to
+ * stop. On a torus, every worker fills in the ghost cells of its band after
+ * stepping it, so that needs no more waiting. */
+static void
+step_job(void *data, int worker) {
+    struct step_job *job = data;
+    struct bitgrid *b = job->b;
+    const int workers = workers_count(job->w);
+    int from, to;
+    workers_band(job->w, worker, b->tile_rows, &from, &to);
+
+    uint64_t *cells = b->cells, *next = b->next;
+    uint8_t *tiles = b->changed, *next_tiles = b->next_changed;
+    long generation = 0, changed = 0;
+    if (b->torus) {
+        fill_ghosts(b, cells, tiles, from, to);
+        workers_sync(job->w);
+    }
+    while (generation < job->n) {
+        long *counts = job->changed + (generation % 2) * workers;
+        uint64_t *hashes = job->hashes + (generation % 2) * workers;
+        hashes[worker] = 0;
+        counts[worker] = step_tiles(b, cells, next, tiles, next_tiles, from,
+            to, b->hashing ? &hashes[worker] : NULL);
+        if (b->torus)
+            fill_ghosts(b, next, next_tiles, from, to);
+        workers_sync(job->w);
+        if (worker == 0) {
+            for (int i = 0; i < workers; i++)
+                b->hash ^= hashes[i];
+        }
+
+        uint64_t *temp = cells;
+        cells = next;
+        next = temp;
+        uint8_t *temp_tiles = tiles;
+        tiles = next_tiles;
+        next_tiles = temp_tiles;
+        generation++;
+
+        changed = 0;
+        for (int i = 0; i < workers; i++)
+            changed += counts[i];
+        if (!changed && job->until_stable)
+            break;
+    }
+    if (b->torus)
+        clear_ghosts(b, cells, from, to);
+
+    if (worker == 0) {
+        b->cells = cells;
+        b->next = next;
+        b->changed = tiles;
+        b->next_changed = next_tiles;
+        job->generations = generation;
+        job->last_changed = changed;
+    }
+}
+
+static inline long
+wrap(long i, long n) {
+    i %= n;
+    return i < 0 ? i + n : i;
+}
+
+/* The 64 cells of a row from column x on, wrapped around on a torus and
+ * dead outside the grid otherwise. Only words on the edges of the grid are
+ * put together cell by cell. */
+static uint64_t
+load_word(const struct bitgrid *b, const uint64_t *cells, long y, long x) {
+    if (b->torus)
+        y = wrap(y, b->rows);
+    else if (y < 0 || y >= b->rows)
+        return 0;
+    const uint64_t *row = row_ptr(cells, b, y);
+    if (x >= 0 && x + WORD_BITS <= b->columns)
+        return row[x / WORD_BITS];
+    uint64_t word = 0;
+    for (int i = 0; i < WORD_BITS; i++) {
+        long c = x + i;
+        if (b->torus)
+            c = wrap(c, b->columns);
+        else if (c < 0 || c >= b->columns)
+            continue;
+        word |= ((row[c / WORD_BITS] >> (c % WORD_BITS)) & 1) << i;
+    }
+    return word;
+}
+
+/* Whether a block or a tile around it changed in the last round. */
+static bool
+block_is_active(const struct bitgrid *b, const uint8_t *changed, int block_y,
+                int block_x) {
+    for (int ty = block_y * BLOCK_TILES - 1;
+            ty <= (block_y + 1) * BLOCK_TILES; ty++) {
+        for (int tx = block_x * BLOCK_TILES - 1;
+                tx <= (block_x + 1) * BLOCK_TILES; tx++) {
+            int y = ty, x = tx;
+            if (b->torus) {
+                y = wrap(y, b->tile_rows);
+                x = wrap(x, b->tile_columns);
+            }
+            else if (y < 0 || y >= b->tile_rows || x < 0 ||
+                    x >= b->tile_columns)
+                continue;
+            if (changed[tile_index(b, y, x)])
+                return true;
+        }
+    }
+    return false;
+}
+
+/* Advances a block k generations in the buffer, from its cells and the
+ * cells up to k rows above and below it and a word on its left and right.
+ * The cells that are still right shrink by a row and a cell on every side
+ * every generation, so only those are stepped, and those of the block are
+ * right after k generations. Outside a bounded grid, cells are killed
+ * again after every generation. Writes the block into next, and the cells
+ * changed in every generation into the buffer. */
+static void
+step_block(const struct bitgrid *b, const uint64_t *cells, uint64_t *next,
+           uint8_t *next_changed, int block_y, int block_x, int k,
+           struct block_buffer *buffer, uint64_t *hash) {
+    const int from_y = block_y * BLOCK_ROWS, from_w = block_x * BLOCK_WORDS;
+    const int rows = from_y + BLOCK_ROWS < b->rows ? BLOCK_ROWS :
+                                                     b->rows - from_y;
+    const int words = from_w + BLOCK_WORDS < b->words ? BLOCK_WORDS :
+                                                        b->words - from_w;
+    // The rows of the buffer are k above the block, and the words one on
+    // its left, with a dead word on either side.
+    const int height = rows + 2 * k, width = words + 2, stride = width + 2;
+    uint64_t *current = buffer->cells, *after = buffer->next;
+    for (int ly = 0; ly < height; ly++) {
+        const long y = from_y - k + ly;
+        uint64_t *row = current + (size_t) ly * stride + 1;
+        row[-1] = row[width] = 0;
+        for (int lw = 0; lw < width; lw++) {
+            const long x = (long) (from_w - 1 + lw) * WORD_BITS;
+            row[lw] = load_word(b, cells, y, x);
+            if (ly == 0) {
+                buffer->inside[lw] = x >= b->columns ? 0 :
+                    x < 0 ? 0 : x + WORD_BITS <= b->columns ?
+                    ~UINT64_C(0) : b->tail_mask;
+            }
+        }
+        buffer->row_inside[ly] = b->torus || (y >= 0 && y < b->rows);
+        row = after + (size_t) ly * stride + 1;
+        row[-1] = row[width] = 0;
+    }
+    memset(buffer->tiles, 0, sizeof(buffer->tiles));
+
+    for (int i = 1; i <= k; i++) {
+        long changed = 0;
+        for (int ly = i; ly < height - i; ly++) {
+            const uint64_t *row = current + (size_t) ly * stride + 1;
+            uint64_t *out = after + (size_t) ly * stride + 1;
+            b->kernel(row - stride, row, row + stride, out, width, b->rule);
+            if (!b->torus) {
+                if (!buffer->row_inside[ly])
+                    memset(out, 0, sizeof(*out) * width);
+                else {
+                    for (int lw = 0; lw < width; lw++)
+                        out[lw] &= buffer->inside[lw];
+                }
+            }
+            if (ly < k || ly >= k + rows)
+                continue;
+            for (int lw = 1; lw <= words; lw++) {
+                const uint64_t diff = (row[lw] ^ out[lw]) &
+                    buffer->inside[lw];
+                changed += __builtin_popcountll(diff);
+                buffer->tiles[(ly - k) / TILE_ROWS][(lw - 1) / TILE_WORDS] |=
+                    diff;
+            }
+        }
+        buffer->changed[i - 1] = changed;
+        uint64_t *temp = current;
+        current = after;
+        after = temp;
+    }
+
+    uint32_t population[BLOCK_TILES][BLOCK_TILES] = { { 0 } };
+    for (int y = 0; y < rows; y++) {
+        const uint64_t *row = current + (size_t) (k + y) * stride + 2;
+        const uint64_t *before = row_ptr(cells, b, from_y + y) + from_w;
+        uint64_t *out = row_ptr(next, b, from_y + y) + from_w;
+        for (int w = 0; w < words; w++) {
+            const uint64_t word = row[w] & buffer->inside[w + 1];
+            out[w] = word;
+            population[y / TILE_ROWS][w / TILE_WORDS] +=
+                __builtin_popcountll(word);
+            const uint64_t old = before[w] & buffer->inside[w + 1];
+            if (hash && old != word) {
+                const uint64_t key = word_key(b, from_y + y, from_w + w);
+                *hash ^= cycle_word_hash(key, old) ^
+                    cycle_word_hash(key, word);
+            }
+        }
+    }
+    for (int ty = 0; ty * TILE_ROWS < rows; ty++) {
+        for (int tx = 0; tx * TILE_WORDS < words; tx++) {
+            const int tile = tile_index(b, block_y * BLOCK_TILES + ty,
+                block_x * BLOCK_TILES + tx);
+            b->population[tile] = population[ty][tx];
+            next_changed[tile] = buffer->tiles[ty][tx] != 0;
+        }
+    }
+}
+
+/* Like step_job(), but every worker advances its band of blocks a round of
+ * generations at a time, reading from cells and writing into next. A block
+ * whose neighborhood didn't change in the last round doesn't change in this
+ * one either. The counts of every generation of a round are summed, so
+ * that a run until stable stops after the first generation in which no
+ * cell changed: the cells after it are the same as after the whole
+ * round. */
+static void
+block_job(void *data, int worker) {
+    struct block_job *job = data;
+    struct bitgrid *b = job->b;
+    struct block_buffer *buffer = job->buffers + worker;
+    const int workers = workers_count(job->w);
+    const int block_rows = (b->rows + BLOCK_ROWS - 1) / BLOCK_ROWS;
+    const int block_columns = (b->words + BLOCK_WORDS - 1) / BLOCK_WORDS;
+    int from, to;
+    workers_band(job->w, worker, block_rows, &from, &to);
+
+    uint64_t *cells = b->cells, *next = b->next;
+    uint8_t *tiles = b->changed, *next_tiles = b->next_changed;
+    long generation = 0, changed = 0, round = 0;
+    while (generation < job->n) {
+        const int k = job->n - generation < b->block ? job->n - generation :
+                                                       b->block;
+        long *counts = job->changed +
+            ((round % 2) * workers + worker) * BITGRID_MAX_BLOCK;
+        uint64_t *hashes = job->hashes + (round % 2) * workers;
+        memset(counts, 0, sizeof(*counts) * k);
+        hashes[worker] = 0;
+        for (int by = from; by < to; by++) {
+            for (int bx = 0; bx < block_columns; bx++) {
+                if (!block_is_active(b, tiles, by, bx)) {
+                    for (int ty = by * BLOCK_TILES;
+                            ty < (by + 1) * BLOCK_TILES && ty < b->tile_rows;
+                            ty++) {
+                        for (int tx = bx * BLOCK_TILES; tx <
+                                (bx + 1) * BLOCK_TILES &&
+                                tx < b->tile_columns; tx++)
+                            next_tiles[tile_index(b, ty, tx)] = 0;
+                    }
+                    continue;
+                }
+                step_block(b, cells, next, next_tiles, by, bx, k, buffer,
+                    b->hashing ? &hashes[worker] : NULL);
+                for (int i = 0; i < k; i++)
+                    counts[i] += buffer->changed[i];
+            }
+        }
+        workers_sync(job->w);
+        if (worker == 0) {
+            for (int i = 0; i < workers; i++)
+                b->hash ^= hashes[i];
+        }
+
+        uint64_t *temp = cells;
+        cells = next;
+        next = temp;
+        uint8_t *temp_tiles = tiles;
+        tiles = next_tiles;
+        next_tiles = temp_tiles;
+        round++;
+
+        const long *all = job->changed + (round - 1) % 2 * workers *
+            BITGRID_MAX_BLOCK;
+        int i = 0;
+        for (; i < k; i++) {
+            changed = 0;
+            for (int j = 0; j < workers; j++)
+                changed += all[j * BITGRID_MAX_BLOCK + i];
+            if (!changed && job->until_stable)
+                break;
+        }
+        generation += i < k ? i + 1 : k;
+        if (i < k)
+            break;
+    }
+
+    if (worker == 0) {
+        b->cells = cells;
+        b->next = next;
+        b->changed = tiles;
+        b->next_changed = next_tiles;
+        job->generations = generation;
+        job->last_changed = changed;
+    }
+}
+
+/* Allocates a buffer for every worker, for blocks advanced up to
+ * BITGRID_MAX_BLOCK generations at a time. Returns NULL on memory error. */
+static struct block_buffer*
+allocate_block_buffers(int workers) {
+    const int height = BLOCK_ROWS + 2 * BITGRID_MAX_BLOCK;
+    const int stride = BLOCK_WORDS + 4;
+    const size_t words = (size_t) height * stride;
+    struct block_buffer *buffers = calloc(workers, sizeof(*buffers));
+    if (!buffers)
+        return NULL;
+    for (int i = 0; i < workers; i++) {
+        buffers[i].cells = malloc(sizeof(uint64_t) * words);
+        buffers[i].next = malloc(sizeof(uint64_t) * words);
+        buffers[i].inside = malloc(sizeof(uint64_t) * (BLOCK_WORDS + 2));
+        buffers[i].row_inside = malloc(sizeof(bool) * height);
+        if (!buffers[i].cells || !buffers[i].next || !buffers[i].inside ||
+                !buffers[i].row_inside) {
+            free_block_buffers(buffers, workers);
+            return NULL;
+        }
+    }
+    return buffers;
+}
+
+/* Allocates the block buffers and counts of the bitgrid for the workers,
+ * unless it has them already. Returns false on memory error. */
+static bool
+prepare_block_buffers(struct bitgrid *b, int workers) {
+    if (b->block_buffers && b->block_workers == workers)
+        return true;
+    free_block_buffers(b->block_buffers, b->block_workers);
+    free(b->block_counts);
+    b->block_buffers = allocate_block_buffers(workers);
+    b->block_counts = malloc(sizeof(*b->block_counts) * 2 * workers *
+                             BITGRID_MAX_BLOCK);
+    b->block_workers = workers;
+    if (b->block_buffers && b->block_counts)
+        return true;
+    free_block_buffers(b->block_buffers, workers);
+    free(b->block_counts);
+    b->block_buffers = NULL;
+    b->block_counts = NULL;
+    return false;
+}
+
+/* Advances in rounds of b->block generations. Returns -1, having done
+ * nothing, on memory error. */
+static long
+step_blocks(struct bitgrid *b, struct workers *w, long n, bool until_stable,
+            long *changed) {
+    const int workers = workers_count(w);
+    if (!prepare_block_buffers(b, workers))
+        return -1;
+    uint64_t hashes[2 * workers];
+    struct block_job job = {
+        .b = b, .w = w, .n = n, .until_stable = until_stable,
+        .buffers = b->block_buffers, .changed = b->block_counts,
+        .hashes = hashes
+    };
+    workers_run(w, block_job, &job);
+    *changed = job.last_changed;
+    return job.generations;
+}
+
+long
+bitgrid_step(struct bitgrid *b, struct workers *w, long n, bool until_stable,
+             long *changed) {
+    // A single generation is stepped as it always is, so that next holds
+    // the generation before.
+    if (b->block > 1 && n > 1 && !b->halo) {
+        const long generations = step_blocks(b, w, n, until_stable, changed);
+        if (generations >= 0)
+            return generations;
+    }
+    long counts[2 * workers_count(w)];
+    uint64_t hashes[2 * workers_count(w)];
+    struct step_job job = {
+        .b = b, .w = w, .n = n, .until_stable = until_stable,
+        .changed = counts, .hashes = hashes
+    };
+    *changed = 0;
+    if (n > 0)
+        workers_run(w, step_job, &job);
+    *changed = job.last_changed;
+    return job.generations;
+}
+
+long
+bitgrid_population(const struct bitgrid *b) {
+    long population = 0;
+    for (int ty = 0; ty < b->tile_rows; ty++) {
+        for (int tx = 0; tx < b->tile_columns; tx++)
+            population += b->population[tile_index(b, ty, tx)];
+    }
+    return population;
+}
+
+uint64_t*
+bitgrid_row(const struct bitgrid *b, int y) {
+    return row_ptr(b->cells, b, y);
+}
+
+void
+bitgrid_rows_written(struct bitgrid *b) {
+    for (int ty = 0; ty < b->tile_rows; ty++) {
+        for (int tx = 0; tx < b->tile_columns; tx++) {
+            const int from = ty * TILE_ROWS;
+            const int to = from + TILE_ROWS < b->rows ? from + TILE_ROWS :
+                                                        b->rows;
+            const int first_word = tx * TILE_WORDS;
+            const int last_word = first_word + TILE_WORDS < b->words ?
+                first_word + TILE_WORDS : b->words;
+            uint32_t population = 0;
+            for (int y = from; y < to; y++) {
+                const uint64_t *row = row_ptr(b->cells, b, y);
+                for (int w = first_word; w < last_word; w++)
+                    population += __builtin_popcountll(row[w]);
+            }
+            b->population[tile_index(b, ty, tx)] = population;
+            b->changed[tile_index(b, ty, tx)] = 1;
+        }
+    }
+    if (b->hashing)
+        bitgrid_track_hash(b);
+}
+
+/* Counts the alive cells of a row from column from to column to. */
+static long
+count_row(const uint64_t *row, int from, int to) {
+    const int first = from / WORD_BITS, last = (to - 1) / WORD_BITS;
+    const uint64_t first_mask = ~UINT64_C(0) << (from % WORD_BITS);
+    const uint64_t last_mask = ~UINT64_C(0) >>
+        (WORD_BITS - 1 - (to - 1) % WORD_BITS);
+    if (first == last)
+        return __builtin_popcountll(row[first] & first_mask & last_mask);
+    long count = __builtin_popcountll(row[first] & first_mask) +
+        __builtin_popcountll(row[last] & last_mask);
+    for (int w = first + 1; w < last; w++)
+        count += __builtin_popcountll(row[w]);
+    return count;
+}
+
+static inline long
+min(long a, long b) {
+    return a < b ? a : b;
+}
+
+static inline long
+max(long a, long b) {
+    return a > b ? a : b;
+}
+
+long
+bitgrid_count(const struct bitgrid *b, long y, long x, long rows,
+              long columns) {
+    const long top = max(y, 0), bottom = min(y + rows, b->rows);
+    const long left = max(x, 0), right = min(x + columns, b->columns);
+    if (top >= bottom || left >= right)
+        return 0;
+
+    const int tile_columns = TILE_WORDS * WORD_BITS;
+    long count = 0;
+    for (long ty = top / TILE_ROWS; ty <= (bottom - 1) / TILE_ROWS; ty++) {
+        const long tile_top = ty * TILE_ROWS;
+        const long tile_bottom = min(tile_top + TILE_ROWS, b->rows);
+        const long from_y = max(top, tile_top), to_y = min(bottom, tile_bottom);
+        for (long tx = left / tile_columns; tx <= (right - 1) / tile_columns;
+                tx++) {
+            const long tile_left = tx * tile_columns;
+            const long tile_right = min(tile_left + tile_columns, b->columns);
+            const long from_x = max(left, tile_left);
+            const long to_x = min(right, tile_right);
+            if (from_y == tile_top && to_y == tile_bottom &&
+                    from_x == tile_left && to_x == tile_right) {
+                count += b->population[tile_index(b, ty, tx)];
+                continue;
+            }
+            for (long ry = from_y; ry < to_y; ry++)
+                count += count_row(row_ptr(b->cells, b, ry), from_x, to_x);
+        }
+    }
+    return count;
+}
+
+void
+bitgrid_span(const struct bitgrid *b, long y, long x, long columns,
+             uint64_t *words) {
+    memset(words, 0, sizeof(*words) * ((columns + WORD_BITS - 1) / WORD_BITS));
+    const long left = max(x, 0), right = min(x + columns, b->columns);
+    if (y < 0 || y >= b->rows || left >= right)
+        return;
+    const uint64_t *row = row_ptr(b->cells, b, y);
+    for (long w = left / WORD_BITS; w <= (right - 1) / WORD_BITS; w++) {
+        const uint64_t word = w == b->words - 1 ? row[w] & b->tail_mask :
+                                                  row[w];
+        life_put_span(words, columns, w * WORD_BITS - x, word);
+    }
+}
+
+bool
+bitgrid_bounds(const struct bitgrid *b, long *top, long *left, long *bottom,
+               long *right) {
+    *top = b->rows;
+    *left = b->columns;
+    *bottom = *right = 0;
+    for (int ty = 0; ty < b->tile_rows; ty++) {
+        const int to_y = min((ty + 1) * TILE_ROWS, b->rows);
+        for (int tx = 0; tx < b->tile_columns; tx++) {
+            if (!b->population[tile_index(b, ty, tx)])
+                continue;
+            const int to_w = min((tx + 1) * TILE_WORDS, b->words);
+            for (int y = ty * TILE_ROWS; y < to_y; y++) {
+                const uint64_t *row = row_ptr(b->cells, b, y);
+                for (int w = tx * TILE_WORDS; w < to_w; w++) {
+                    if (row[w])
+                        life_bound_word(row[w], y, (long) w * WORD_BITS, top,
+                            left, bottom, right);
+                }
+            }
+        }
+    }
+    return *top < *bottom;
+}
+
+void
+bitgrid_track_hash(struct bitgrid *b) {
+    b->hash = 0;
+    for (int y = 0; y < b->rows; y++) {
+        const uint64_t *row = row_ptr(b->cells, b, y);
+        for (int w = 0; w < b->words; w++)
+            b->hash ^= cycle_word_hash(word_key(b, y, w), row[w]);
+    }
+    b->hashing = true;
+}
@@ -0,0 +1,137 @@
+#ifndef BITGRID_H
+    #define BITGRID_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rule.h"
+#include "workers.h"
+#define BITGRID_MAX_BLOCK 32
+
+/* Bit-packed grid, one bit per cell. Column x of a row is bit x % 64 of word
+ * x / 64. Every row has a word of ghost cells on both sides and the grid has
+ * a row of them above and below it, so the step kernel never checks bounds.
+ * The ghost cells are dead, or on a torus copies of the opposite edge, which
+ * are filled in before every generation. The ghost cell past the last column
+ * is in the last word when the columns don't fill it; it's cleared after
+ * stepping.
+ *
+ * The grid is divided into tiles that remember whether they changed in the
+ * last generation. A tile is stepped only if it or one of its neighbors
+ * changed.
+ *
+ * With block set, several generations are advanced at a time in blocks of
+ * tiles: a block is copied with the rows and columns around it that reach
+ * it in that many generations into a buffer small enough to stay in the
+ * cache, stepped there, and only its last generation is written back. */
+typedef void (*bitgrid_kernel)(const uint64_t*, const uint64_t*,
+                               const uint64_t*, uint64_t*, int, struct rule);
+
+struct bitgrid {
+    int rows, columns;
+    // Steps a row of words with the rule.
+    struct rule rule;
+    bitgrid_kernel kernel;
+    // Words per row holding cells, and words per row including padding.
+    int words, stride;
+    // Mask of the valid bits in the last word of a row.
+    uint64_t tail_mask;
+    // The edges wrap around. With a halo, only the left and right ones do,
+    // and the ghost rows are set from outside.
+    bool torus, halo;
+    uint64_t *cells, *next;
+    // Number of tiles, and tiles per row of flags including a border.
+    int tile_rows, tile_columns, tile_stride;
+    // Tiles that changed in the last generation and in this one.
+    uint8_t *changed, *next_changed;
+    // Alive cells in each tile, indexed like the flags.
+    uint32_t *population;
+    // Hash of the cells for finding cycles, kept only after
+    // bitgrid_track_hash().
+    bool hashing;
+    uint64_t hash;
+    // Generations advanced at a time in blocks, at most BITGRID_MAX_BLOCK,
+    // or 0 or 1 to step a generation at a time.
+    int block;
+    // Buffers of the workers stepping blocks and their counts, allocated
+    // on the first block step for block_workers workers.
+    struct block_buffer *block_buffers;
+    long *block_counts;
+    int block_workers;
+};
+
+struct bitgrid*
+bitgrid_init(int rows, int columns, struct rule rule, bool torus);
+
+void
+bitgrid_free(struct bitgrid *b);
+
+bool
+bitgrid_get(const struct bitgrid *b, int y, int x);
+
+void
+bitgrid_set(struct bitgrid *b, int y, int x, bool alive);
+
+/* Flips the cells of a word of a row that are set in flip. */
+void
+bitgrid_flip(struct bitgrid *b, int y, int word, uint64_t flip);
+
+/* Stores the cells of a row that flipped in the last generation, as the XOR
+ * of the words before and after, into flips. Returns false, with flips all
+ * zero, if no tile of the row changed. Only right after stepping a single
+ * generation. */
+bool
+bitgrid_row_flips(const struct bitgrid *b, int y, uint64_t *flips);
+
+/* Makes the grid a slab of a bigger one: the ghost rows are the rows above
+ * and below the slab, words of cells each, or dead if NULL. Call before
+ * every generation. The tiles next to a ghost row are stepped only if it
+ * changed since the generation before. */
+void
+bitgrid_set_halo(struct bitgrid *b, const uint64_t *above,
+                 const uint64_t *below);
+
+/* Advances at most n generations, each worker stepping its own band of rows.
+ * With until_stable, stops after a generation in which no cell changed.
+ * Returns the number of generations advanced and stores the number of cells
+ * changed in the last one in changed. */
+long
+bitgrid_step(struct bitgrid *b, struct workers *w, long n, bool until_stable,
+             long *changed);
+
+long
+bitgrid_population(const struct bitgrid *b);
+
+/* The words of a row, for copying whole rows in and out. Bits past the last
+ * column must be zero. Call bitgrid_rows_written() after writing rows. */
+uint64_t*
+bitgrid_row(const struct bitgrid *b, int y);
+
+/* Brings the populations, flags and hash of the tiles up to date after rows
+ * were written through bitgrid_row(). */
+void
+bitgrid_rows_written(struct bitgrid *b);
+
+/* Counts the alive cells in a rectangle, which may reach outside the grid.
+ * Whole tiles inside it are counted from their populations. */
+long
+bitgrid_count(const struct bitgrid *b, long y, long x, long rows,
+              long columns);
+
+/* Stores the cells of row y from column x on into a span of columns cells,
+ * cell i in bit i % 64 of words[i / 64]. Cells outside the grid are dead. */
+void
+bitgrid_span(const struct bitgrid *b, long y, long x, long columns,
+             uint64_t *words);
+
+/* Stores the smallest rectangle holding every alive cell, from (top, left)
+ * to before (bottom, right), looking only at tiles with a population.
+ * Returns false if nothing is alive. */
+bool
+bitgrid_bounds(const struct bitgrid *b, long *top, long *left, long *bottom,
+               long *right);
+
+/* Hashes the cells and keeps the hash up to date from then on. */
+void
+bitgrid_track_hash(struct bitgrid *b);
+
+#endif // BITGRID_H
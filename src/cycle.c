@@ -0,0 +1,52 @@
+#include "cycle.h"
+#include <stdlib.h>
+
+/* A ring of the hashes of the last window generations. */
+struct cycle {
+    uint64_t *hashes;
+    long *generations;
+    int window, count, next;
+};
+
+struct cycle*
+cycle_init(int window) {
+    struct cycle *c = malloc(sizeof(*c));
+    if (!c)
+        return NULL;
+    c->hashes = malloc(sizeof(*c->hashes) * window);
+    c->generations = malloc(sizeof(*c->generations) * window);
+    if (!c->hashes || !c->generations) {
+        cycle_free(c);
+        return NULL;
+    }
+    c->window = window;
+    c->count = c->next = 0;
+    return c;
+}
+
+void
+cycle_free(struct cycle *c) {
+    if (!c)
+        return;
+    free(c->hashes);
+    free(c->generations);
+    free(c);
+}
+
+bool
+cycle_add(struct cycle *c, long generation, uint64_t hash, long *period) {
+    // From the latest generation back, so the shortest period is found.
+    for (int i = 1; i <= c->count; i++) {
+        const int j = (c->next - i + c->window) % c->window;
+        if (c->hashes[j] == hash) {
+            *period = generation - c->generations[j];
+            return true;
+        }
+    }
+    c->hashes[c->next] = hash;
+    c->generations[c->next] = generation;
+    c->next = (c->next + 1) % c->window;
+    if (c->count < c->window)
+        c->count++;
+    return false;
+}
@@ -0,0 +1,40 @@
+#ifndef CYCLE_H
+    #define CYCLE_H
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Remembers the hashes of the last generations to find out when the table
+ * repeats itself. The engines keep a hash of their cells up to date as cells
+ * change: the hash of a table is the XOR of the hashes of its nonzero words,
+ * so a changed word is moved in and out of it with two XORs. */
+struct cycle;
+
+struct cycle*
+cycle_init(int window);
+
+void
+cycle_free(struct cycle *c);
+
+/* Adds the hash of a generation. Returns true and stores the distance to the
+ * latest generation with the same hash in period if there is one in the
+ * window. */
+bool
+cycle_add(struct cycle *c, long generation, uint64_t hash, long *period);
+
+static inline uint64_t
+cycle_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= UINT64_C(0xBF58476D1CE4E5B9);
+    x ^= x >> 27;
+    x *= UINT64_C(0x94D049BB133111EB);
+    return x ^ (x >> 31);
+}
+
+/* Hash of a word of cells at a position given by key. Empty words hash to 0,
+ * so they can be left out. */
+static inline uint64_t
+cycle_word_hash(uint64_t key, uint64_t word) {
+    return word ? cycle_mix(key * UINT64_C(0x9E3779B97F4A7C15) ^ word) : 0;
+}
+
+#endif // CYCLE_H
@@ -0,0 +1,207 @@
+#include "display.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define FRAME_SECONDS (1.0 / DISPLAY_FRAMES_PER_SECOND)
+#define MAX_RATE (1L << 30)
+// Set in the index of the middle frame when it's newer than the front one.
+#define FRESH 4
+
+struct display {
+    struct gol *g;
+    display_step step;
+    void *data;
+    pthread_t thread;
+    // The stepping thread captures into the back frame and swaps it with the
+    // middle one, and the interface swaps the middle one with the front one
+    // it draws, when it's fresh.
+    struct frame frames[3];
+    int back, front;
+    atomic_int middle;
+    // The view the interface wants, under the mutex.
+    pthread_mutex_t mutex;
+    struct frame_view view;
+    atomic_bool view_changed;
+    // Generations per second, 0 as fast as possible, and the rate reached
+    // over the last frame.
+    atomic_long rate, reached;
+    atomic_bool paused, quit, finished, failed;
+};
+
+static double
+seconds() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void
+sleep_until(double time, double now) {
+    const double wait = time - now;
+    if (wait <= 0)
+        return;
+    const struct timespec t = {
+        .tv_sec = (time_t) wait,
+        .tv_nsec = (long) ((wait - (time_t) wait) * 1e9)
+    };
+    nanosleep(&t, NULL);
+}
+
+static bool
+publish(struct display *d) {
+    struct frame_view view;
+    pthread_mutex_lock(&d->mutex);
+    view = d->view;
+    atomic_store(&d->view_changed, false);
+    pthread_mutex_unlock(&d->mutex);
+
+    const uint64_t start = d->g->stats ? stats_now() : 0;
+    if (!frame_capture(&d->frames[d->back], d->g, &view))
+        return false;
+    if (d->g->stats)
+        stats_time(d->g->stats, STATS_CAPTURE, start);
+    d->back = atomic_exchange(&d->middle, d->back | FRESH) & ~FRESH;
+    return true;
+}
+
+/* Captures a frame when the view changes, or when the generation changed
+ * and the last frame is at least a frame old, so capturing costs nothing
+ * much however fast the game is stepped. */
+static void*
+stepping_thread(void *arg) {
+    struct display *d = arg;
+    double next_step = seconds(), last_frame = next_step - FRAME_SECONDS;
+    long stepped = 0;
+    bool running = true, dirty = true;
+    while (!atomic_load(&d->quit)) {
+        double now = seconds();
+        if (!running || atomic_load(&d->view_changed) ||
+                (dirty && now - last_frame >= FRAME_SECONDS)) {
+            if (!publish(d)) {
+                atomic_store(&d->failed, true);
+                break;
+            }
+            if (!running)
+                break;
+            atomic_store(&d->reached, (long) (stepped / (now - last_frame)));
+            stepped = 0;
+            last_frame = now;
+            dirty = false;
+        }
+
+        const long rate = atomic_load(&d->rate);
+        const bool paused = atomic_load(&d->paused);
+        if (!paused && now >= next_step) {
+            running = d->step(d->g, d->data);
+            stepped++;
+            dirty = true;
+            // Falling behind more than a frame isn't made up for.
+            next_step = rate ? next_step + 1.0 / rate : now;
+            if (next_step < now - FRAME_SECONDS)
+                next_step = now;
+        }
+        else if (paused || rate) {
+            double wake = paused ? now + FRAME_SECONDS : next_step;
+            if (dirty && last_frame + FRAME_SECONDS < wake)
+                wake = last_frame + FRAME_SECONDS;
+            if (wake > now + FRAME_SECONDS)
+                wake = now + FRAME_SECONDS;
+            const uint64_t start = d->g->stats ? stats_now() : 0;
+            sleep_until(wake, now);
+            if (d->g->stats)
+                stats_time(d->g->stats, STATS_SLEEP, start);
+        }
+    }
+    atomic_store(&d->finished, true);
+    return NULL;
+}
+
+struct display*
+display_init(struct gol *g, display_step step, void *data,
+             const struct frame_view *view, long rate) {
+    struct display *d = malloc(sizeof(*d));
+    if (!d)
+        return NULL;
+    memset(d, 0, sizeof(*d));
+    d->g = g;
+    d->step = step;
+    d->data = data;
+    d->front = 0;
+    atomic_init(&d->middle, 1);
+    d->back = 2;
+    d->view = *view;
+    atomic_init(&d->view_changed, false);
+    atomic_init(&d->rate, rate);
+    atomic_init(&d->reached, 0);
+    atomic_init(&d->paused, false);
+    atomic_init(&d->quit, false);
+    atomic_init(&d->finished, false);
+    atomic_init(&d->failed, false);
+    pthread_mutex_init(&d->mutex, NULL);
+    if (pthread_create(&d->thread, NULL, stepping_thread, d) != 0) {
+        pthread_mutex_destroy(&d->mutex);
+        free(d);
+        return NULL;
+    }
+    return d;
+}
+
+void
+display_free(struct display *d) {
+    if (!d)
+        return;
+    atomic_store(&d->quit, true);
+    pthread_join(d->thread, NULL);
+    pthread_mutex_destroy(&d->mutex);
+    for (int i = 0; i < 3; i++)
+        frame_free(&d->frames[i]);
+    free(d);
+}
+
+const struct frame*
+display_frame(struct display *d) {
+    if (!(atomic_load(&d->middle) & FRESH))
+        return NULL;
+    d->front = atomic_exchange(&d->middle, d->front) & ~FRESH;
+    return &d->frames[d->front];
+}
+
+bool
+display_finished(const struct display *d) {
+    return atomic_load(&d->finished);
+}
+
+bool
+display_failed(const struct display *d) {
+    return atomic_load(&d->failed);
+}
+
+void
+display_set_view(struct display *d, const struct frame_view *view) {
+    pthread_mutex_lock(&d->mutex);
+    d->view = *view;
+    atomic_store(&d->view_changed, true);
+    pthread_mutex_unlock(&d->mutex);
+}
+
+void
+display_toggle_pause(struct display *d) {
+    atomic_store(&d->paused, !atomic_load(&d->paused));
+}
+
+void
+display_speed_up(struct display *d) {
+    const long rate = atomic_load(&d->rate);
+    if (rate)
+        atomic_store(&d->rate, rate < MAX_RATE ? 2 * rate : 0);
+}
+
+void
+display_slow_down(struct display *d) {
+    long rate = atomic_load(&d->rate);
+    if (!rate)
+        rate = atomic_load(&d->reached);
+    atomic_store(&d->rate, rate > 1 ? rate / 2 : 1);
+}
@@ -0,0 +1,57 @@
+#ifndef DISPLAY_H
+    #define DISPLAY_H
+#include "frame.h"
+#include "gol.h"
+#include <stdbool.h>
+#define DISPLAY_FRAMES_PER_SECOND 30
+
+/* Steps the game on a thread of its own, as fast as it can or at a target
+ * rate, while the interface draws the latest generation at a fixed frame
+ * rate. The stepping thread captures what the view shows into frames that
+ * are handed over in a triple buffer, so neither side waits for the other.
+ * Only the stepping thread looks at g until display_free(). */
+struct display;
+
+/* Steps one generation. Returns false when the game is over. */
+typedef bool (*display_step)(struct gol *g, void *data);
+
+/* Starts stepping at rate generations per second, or as fast as possible if
+ * rate is 0. Returns NULL on error. */
+struct display*
+display_init(struct gol *g, display_step step, void *data,
+             const struct frame_view *view, long rate);
+
+/* Stops stepping and waits for the thread. */
+void
+display_free(struct display *d);
+
+/* Returns the latest frame if there's one the interface hasn't had yet, NULL
+ * otherwise. The frame stays the interface's until the next call. */
+const struct frame*
+display_frame(struct display *d);
+
+/* Whether the game is over and its last generation is in a frame, or it
+ * couldn't be captured. */
+bool
+display_finished(const struct display *d);
+
+/* Whether a frame couldn't be captured for lack of memory. */
+bool
+display_failed(const struct display *d);
+
+/* Captures the view from the next frame on. */
+void
+display_set_view(struct display *d, const struct frame_view *view);
+
+void
+display_toggle_pause(struct display *d);
+
+/* Doubles the target rate, or halves it. Slowing down from as fast as
+ * possible halves the rate reached. */
+void
+display_speed_up(struct display *d);
+
+void
+display_slow_down(struct display *d);
+
+#endif // DISPLAY_H
@@ -0,0 +1,105 @@
+#include "frame.h"
+#include <stdlib.h>
+
+// Bits of the dots of a Braille character, by row and column.
+static const uint8_t braille_dots[4][2] = {
+    { 0x01, 0x08 }, { 0x02, 0x10 }, { 0x04, 0x20 }, { 0x40, 0x80 }
+};
+
+long
+frame_scale(const struct frame_view *v) {
+    if (v->zoom == 0)
+        return 1;
+    return v->braille ? 1L << (v->zoom - 1) : 1L << v->zoom;
+}
+
+long
+frame_character_rows(const struct frame_view *v) {
+    return v->zoom && v->braille ? 4 * frame_scale(v) : frame_scale(v);
+}
+
+long
+frame_character_columns(const struct frame_view *v) {
+    return v->zoom && v->braille ? 2 * frame_scale(v) : frame_scale(v);
+}
+
+/* Codes a row of objects from a span of them. */
+static void
+cell_codes(const struct gol *g, const struct frame_view *v, long y,
+           uint64_t *words, uint8_t *codes) {
+    gol_span(g, y, v->x, v->columns, words);
+    for (int column = 0; column < v->columns; column++) {
+        codes[column] = (words[column / 64] >> (column % 64)) & 1 ?
+            FRAME_ALIVE : FRAME_NOT_ALIVE;
+    }
+    if (!gol_is_bounded(g))
+        return;
+    for (int column = 0; column < v->columns; column++) {
+        const long x = v->x + column;
+        if (y < 0 || y >= g->rows || x < 0 || x >= g->columns)
+            codes[column] = FRAME_OUTSIDE;
+    }
+}
+
+static uint8_t
+block_code(const struct gol *g, const struct frame_view *v, long y, long x) {
+    const long s = frame_scale(v);
+    if (v->braille) {
+        uint8_t dots = 0;
+        for (int dy = 0; dy < 4; dy++) {
+            for (int dx = 0; dx < 2; dx++) {
+                if (gol_count(g, y + dy * s, x + dx * s, s, s))
+                    dots |= braille_dots[dy][dx];
+            }
+        }
+        return dots;
+    }
+    const long n = gol_count(g, y, x, s, s);
+    if (!n)
+        return 0;
+    // In double, as the cells of a character far out overflow a long.
+    return 1 + (long) ((double) n / s / s * (FRAME_DENSITY_LEVELS - 2));
+}
+
+bool
+frame_capture(struct frame *f, const struct gol *g,
+              const struct frame_view *v) {
+    const size_t size = (size_t) v->rows * v->columns;
+    if (size > f->capacity) {
+        uint8_t *codes = realloc(f->codes, size);
+        if (!codes)
+            return false;
+        f->codes = codes;
+        f->capacity = size;
+    }
+    f->view = *v;
+    f->generation = g->generation;
+
+    if (!v->zoom) {
+        uint64_t words[(v->columns + 63) / 64 + 1];
+        for (int row = 0; row < v->rows; row++) {
+            cell_codes(g, v, v->y + row, words,
+                f->codes + (size_t) row * v->columns);
+        }
+        return true;
+    }
+
+    const long character_rows = frame_character_rows(v);
+    const long character_columns = frame_character_columns(v);
+    uint8_t *code = f->codes;
+    for (int row = 0; row < v->rows; row++) {
+        const long y = v->y + row * character_rows;
+        for (int column = 0; column < v->columns; column++) {
+            const long x = v->x + column * character_columns;
+            *code++ = block_code(g, v, y, x);
+        }
+    }
+    return true;
+}
+
+void
+frame_free(struct frame *f) {
+    free(f->codes);
+    f->codes = NULL;
+    f->capacity = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef FRAME_H
+    #define FRAME_H
+#include "gol.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// Codes of the characters of an unzoomed frame. Zoomed out, the code is the
+// bits of the dots of a Braille character or the index of a density glyph.
+#define FRAME_NOT_ALIVE 0
+#define FRAME_ALIVE 1
+#define FRAME_OUTSIDE 2
+#define FRAME_DENSITY_LEVELS 10
+
+/* The part of the table shown on the screen. Zoomed out, every character
+ * stands for a block of objects: a dot of a Braille character for a square
+ * of them, or a density glyph for the whole block. */
+struct frame_view {
+    long y, x;
+    int rows, columns;
+    int zoom;
+    bool braille;
+};
+
+/* What the screen shows of one generation, one code per character, so that
+ * it can be drawn while the engine steps the next ones. */
+struct frame {
+    struct frame_view view;
+    long generation;
+    uint8_t *codes;
+    size_t capacity;
+};
+
+/* Side of the square of objects a dot or a density glyph stands for. */
+long
+frame_scale(const struct frame_view *v);
+
+/* Objects a character stands for vertically and horizontally. */
+long
+frame_character_rows(const struct frame_view *v);
+
+long
+frame_character_columns(const struct frame_view *v);
+
+/* Looks at the objects in the view. Returns false on memory error. */
+bool
+frame_capture(struct frame *f, const struct gol *g,
+              const struct frame_view *v);
+
+void
+frame_free(struct frame *f);
+
+#endif // FRAME_H
@@ -1,86 +1,113 @@
 #include "gol.h"
+#include "display.h"
+#include "pattern.h"
+#include "record.h"
+#include "slabs.h"
+#include "snapshot.h"
+#include "soup.h"
 #ifdef HAVE_NCURSES
     #include "ncurses_ui.h"
+#else
+    #include "terminal.h"
 #endif
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <time.h>
 #include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
-#define WAIT_NSECS 300000000L
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define TABLE_ALIGNMENT 64
+#define HASHLIFE_MAX_NODES (1 << 22)
+#define DEFAULT_CHECKPOINT_FILE "gol.snapshot"
 
-static int
-get_number_of_alive_neighbors(const struct gol *g, int y, int x) {
-    int n = 0;
-    // Row above current object.
-    if (y - 1 >= 0) {
-        if (x - 1 >= 0)
-            n += g->table[y - 1][x - 1].alive_this_round ? 1 : 0;
-        n += g->table[y - 1][x].alive_this_round ? 1 : 0;
-        if (x + 1 < g->columns)
-            n += g->table[y - 1][x + 1].alive_this_round ? 1 : 0;
-    }
-    // Same row as current object.
-    if (x - 1 >= 0)
-        n += g->table[y][x - 1].alive_this_round ? 1 : 0;
-    if (x + 1 < g->columns)
-        n += g->table[y][x + 1].alive_this_round ? 1 : 0;
-    // Row below current object.
-    if (y + 1 < g->rows) {
-        if (x - 1 >= 0)
-            n += g->table[y + 1][x - 1].alive_this_round ? 1 : 0;
-        n += g->table[y + 1][x].alive_this_round ? 1 : 0;
-        if (x + 1 < g->columns)
-            n += g->table[y + 1][x + 1].alive_this_round ? 1 : 0;
-    }
-
-    return n;
-}
+struct step_job {
+    struct gol *g;
+    long n;
+    bool until_stable;
+    // Objects moved by each worker and the changes to the hash, for two
+    // generations in turn.
+    long *objects_moved;
+    uint64_t *hashes;
+    long generations, last_objects_moved;
+};
 
-static bool
-alive_next_round(struct gol *g, int y, int x) {
-    int n = get_number_of_alive_neighbors(g, y, x);
-    if (g->table[y][x].alive_this_round) {
-        if (n < 2)
-            return false;
-        else if (n == 2 || n == 3)
-            return true;
-        else
-            return false;
-    }
-    else
-        return n == 3;
-}
+struct search_job {
+    const struct options_opts *opts;
+    uint64_t first_seed;
+    // The next soup to be taken by a worker.
+    atomic_long next;
+    atomic_bool failed;
+};
 
-static void
-set_alive_next_round_cb(struct gol *g, void *data, int y, int x) {
-    g->table[y][x].alive_next_round = alive_next_round(g, y, x);
-}
+struct soup_job {
+    struct gol *g;
+    struct soup soup;
+    int words;
+};
 
-static void
-set_alive_this_round_cb(struct gol *g, void *data, int y, int x) {
-    int *objects_moved = data;
-    if (g->table[y][x].alive_this_round != g->table[y][x].alive_next_round)
-        (*objects_moved)++;
+enum map_error {
+    MAP_OK, MAP_EMPTY_ROW, MAP_DIFFERENT_COLUMNS, MAP_ILLEGAL_CHARACTER
+};
+
+struct map_job {
+    struct gol *g;
+    const unsigned char *data;
+    size_t size, columns;
+    int rows;
+    unsigned char alive, not_alive;
+    // First bad row of each worker and what was wrong with it.
+    int *error_rows;
+    enum map_error *errors;
+};
 
-    g->table[y][x].alive_this_round = g->table[y][x].alive_next_round;
-    g->table[y][x].alive_next_round = false;
+static inline size_t
+offset(const struct gol *g, int y, int x) {
+    if (g->padded)
+        return (size_t) (y + 1) * (g->columns + 2) + x + 1;
+    return (size_t) y * g->columns + x;
 }
 
-#ifndef HAVE_NCURSES
-static void
-print_cb(struct gol *g, void *data, int y, int x) {
-    printf("%lc", g->table[y][x].alive_this_round ? g->alive_character :
-                                                    g->not_alive_character);
-    if (x == g->columns - 1)
-        printf("\n");
+/* Writes the next round of rows from to to into next and returns the number
+ * of objects that moved. Unless hash is NULL, the objects that moved are
+ * moved in and out of it. */
+static long
+step_rows(const struct gol *g, const bool *table, bool *next, int from,
+          int to, uint64_t *hash) {
+    long objects_moved = 0;
+    for (int y = from; y < to; y++) {
+        const bool *up = table + offset(g, y - 1, 0);
+        const bool *row = table + offset(g, y, 0);
+        const bool *down = table + offset(g, y + 1, 0);
+        for (int x = 0; x < g->columns; x++) {
+            const int n = up[x - 1] + up[x] + up[x + 1] + row[x - 1] +
+                row[x + 1] + down[x - 1] + down[x] + down[x + 1];
+            const size_t i = offset(g, y, x);
+            next[i] = rule_next(g->rule, row[x], n);
+            if (next[i] != table[i]) {
+                objects_moved++;
+                if (hash)
+                    *hash ^= cycle_mix(i);
+            }
+        }
+    }
+    return objects_moved;
 }
-#endif
 
-static inline bool
-is_object_alive_at_start(double probability) {
-     return ((double) rand() / RAND_MAX) <= probability;
+static uint64_t
+table_hash(const struct gol *g) {
+    uint64_t hash = 0;
+    for (int y = 0; y < g->rows; y++) {
+        for (int x = 0; x < g->columns; x++) {
+            if (g->table[offset(g, y, x)])
+                hash ^= cycle_mix(offset(g, y, x));
+        }
+    }
+    return hash;
 }
 
 static inline bool
@@ -154,31 +181,45 @@ readline(FILE *fp, wchar_t **buf, size_t *size, int *error_errno) {
 }
 
 static bool
-validate_and_copy_row(const wchar_t *row, int y, struct gol *g) {
+validate_and_copy_row(const wchar_t *row, bool *objects, struct gol *g) {
     for (int x = 0; row[x] != L'\0'; x++) {
         if (row[x] == g->alive_character)
-            g->table[y][x].alive_this_round = true;
+            objects[x] = true;
         else if (row[x] == g->not_alive_character)
-            g->table[y][x].alive_this_round = false;
+            objects[x] = false;
         else
             return false;
-
-        g->table[y][x].alive_next_round = false;
     }
     return true;
 }
 
+bool*
+gol_allocate_table(size_t objects) {
+    size_t size = (objects * sizeof(bool) + TABLE_ALIGNMENT - 1) /
+        TABLE_ALIGNMENT * TABLE_ALIGNMENT;
+    return aligned_alloc(TABLE_ALIGNMENT, size ? size : TABLE_ALIGNMENT);
+}
+
+/* Makes room for one more row, doubling the size of the table when it's
+ * full. aligned_alloc() has no realloc counterpart, so the rows are copied. */
 static bool
-allocate_memory_for_rows(struct gol *g, int row, int columns) {
-    struct object **temp_rows =
-        realloc(g->table, sizeof(*(g->table)) * (row + 1));
-    if (!temp_rows)
-        return false;
-    g->table = temp_rows;
+allocate_memory_for_row(struct gol *g, int row, int columns,
+                        size_t *capacity) {
+    const size_t needed = (size_t) (row + 1) * columns;
+    if (needed <= *capacity)
+        return true;
 
-    g->table[row] = malloc(sizeof(**(g->table)) * columns);
-    if (!g->table[row])
+    size_t new_capacity = *capacity ? *capacity * 2 : needed;
+    while (new_capacity < needed)
+        new_capacity *= 2;
+    bool *temp = gol_allocate_table(new_capacity);
+    if (!temp)
         return false;
+    if (g->table)
+        memcpy(temp, g->table, sizeof(bool) * row * columns);
+    free(g->table);
+    g->table = temp;
+    *capacity = new_capacity;
     return true;
 }
 
@@ -190,6 +231,7 @@ read_table(FILE *fp, struct gol *g) {
     size_t size = 10;
     int error = 0;
     bool retval = true;
+    size_t capacity = 0;
     int columns, row = 0, last_row_columns = FIRST_ROW;
     while ((columns = readline(fp, &buf, &size, &error)) > 0) {
         if (columns == 1) {
@@ -197,22 +239,23 @@ read_table(FILE *fp, struct gol *g) {
             retval = false;
             goto end;
         }
-        if (!allocate_memory_for_rows(g, row, columns - 1)) {
-            fprintf(stderr, "memory error\n");
+        if (last_row_columns != FIRST_ROW && last_row_columns != columns) {
+            fprintf(stderr, "different number of columns\n");
             retval = false;
             goto end;
         }
-        if (!validate_and_copy_row(buf, row, g)) {
-            fprintf(stderr, "illegal character\n");
+        if (!allocate_memory_for_row(g, row, columns - 1, &capacity)) {
+            fprintf(stderr, "memory error\n");
             retval = false;
             goto end;
         }
-
-        if (last_row_columns != FIRST_ROW && last_row_columns != columns) {
-            fprintf(stderr, "different number of columns\n");
+        if (!validate_and_copy_row(buf, g->table + (size_t) row * (columns - 1),
+                g)) {
+            fprintf(stderr, "illegal character\n");
             retval = false;
             goto end;
         }
+
         last_row_columns = columns;
         row++;
     }
@@ -232,25 +275,800 @@ read_table(FILE *fp, struct gol *g) {
         return retval;
 }
 
+/* Rows are all columns + 1 bytes long with the newline, so row y starts at
+ * a known offset and the workers can convert their rows without scanning
+ * the rows before them. A newline inside a row means it was too short. */
+static enum map_error
+convert_row(const struct map_job *job, int y) {
+    const size_t start = (size_t) y * (job->columns + 1);
+    const size_t left = job->size - start;
+    const size_t length = left < job->columns ? left : job->columns;
+    const unsigned char *row = job->data + start;
+
+    const unsigned char *newline = memchr(row, '\n', length);
+    if (newline)
+        return newline == row ? MAP_EMPTY_ROW : MAP_DIFFERENT_COLUMNS;
+    if (length < job->columns ||
+            (length < left && row[job->columns] != '\n'))
+        return MAP_DIFFERENT_COLUMNS;
+    // Like with read_table(), only a single row may end without a newline.
+    if (y > 0 && left == job->columns)
+        return MAP_DIFFERENT_COLUMNS;
+
+    bool *objects = job->g->table + (size_t) y * job->columns;
+    bool illegal = false;
+    for (size_t x = 0; x < job->columns; x++) {
+        objects[x] = row[x] == job->alive;
+        illegal |= row[x] != job->alive && row[x] != job->not_alive;
+    }
+    return illegal ? MAP_ILLEGAL_CHARACTER : MAP_OK;
+}
+
+static void
+map_job(void *data, int worker) {
+    struct map_job *job = data;
+    int from, to;
+    workers_band(job->g->workers, worker, job->rows, &from, &to);
+    job->errors[worker] = MAP_OK;
+    for (int y = from; y < to; y++) {
+        enum map_error error = convert_row(job, y);
+        if (error != MAP_OK) {
+            job->error_rows[worker] = y;
+            job->errors[worker] = error;
+            return;
+        }
+    }
+}
+
+/* The bands are in order, so the first worker with an error has the first
+ * bad row, and that's the one read_table() would complain about. */
 static bool
-generate_table(struct gol *g, const struct options_opts *opts) {
-    g->table = malloc(sizeof(*(g->table)) * opts->rows);
-    if (!g->table)
-        return false;
+convert_mapped_rows(struct map_job *job) {
+    const int workers = workers_count(job->g->workers);
+    int error_rows[workers];
+    enum map_error errors[workers];
+    job->error_rows = error_rows;
+    job->errors = errors;
+    workers_run(job->g->workers, map_job, job);
 
-    srand(time(NULL));
- 
-    for (int y = 0; y < opts->rows; y++) {
-        g->table[y] = malloc(sizeof(**(g->table)) * opts->columns);
-        if (!g->table[y])
+    for (int i = 0; i < workers; i++) {
+        if (errors[i] == MAP_EMPTY_ROW)
+            fprintf(stderr, "empty row\n");
+        else if (errors[i] == MAP_DIFFERENT_COLUMNS)
+            fprintf(stderr, "different number of columns\n");
+        else if (errors[i] == MAP_ILLEGAL_CHARACTER)
+            fprintf(stderr, "illegal character\n");
+        if (errors[i] != MAP_OK)
             return false;
+    }
+    return true;
+}
+
+/* A faster read_table() for regular files whose alive and not alive
+ * characters are single bytes: the file is mapped into memory and the rows
+ * are converted by the workers. Sets mapped to false without printing
+ * anything if the file has to be read with read_table() instead. */
+static bool
+map_table(const char *file, struct gol *g, bool *mapped) {
+    *mapped = false;
+    if (file_is_stdin(file) || g->alive_character > 0x7f ||
+            g->not_alive_character > 0x7f)
+        return true;
+    int fd = open(file, O_RDONLY);
+    if (fd == -1)
+        return true;
+
+    bool retval = true;
+    struct stat st;
+    void *data = MAP_FAILED;
+    size_t size = 0;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        goto end;
+    size = st.st_size;
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        goto end;
+    madvise(data, size, MADV_SEQUENTIAL);
+    *mapped = true;
+
+    const unsigned char *newline = memchr(data, '\n', size);
+    struct map_job job = {
+        .g = g, .data = data, .size = size,
+        .columns = newline ? (size_t) (newline - (unsigned char*) data) : size,
+        .alive = g->alive_character, .not_alive = g->not_alive_character
+    };
+    if (job.columns == 0) {
+        fprintf(stderr, "empty row\n");
+        retval = false;
+        goto end;
+    }
+    const size_t rows = size / (job.columns + 1) +
+        (size % (job.columns + 1) != 0);
+    if (rows > INT_MAX || job.columns > INT_MAX) {
+        fprintf(stderr, "table too large\n");
+        retval = false;
+        goto end;
+    }
+    job.rows = rows;
+
+    g->table = gol_allocate_table(rows * job.columns);
+    if (!g->table) {
+        fprintf(stderr, "memory error\n");
+        retval = false;
+        goto end;
+    }
+    if (!convert_mapped_rows(&job)) {
+        free(g->table);
+        g->table = NULL;
+        retval = false;
+        goto end;
+    }
+    g->rows = job.rows;
+    g->columns = job.columns;
+
+    end:
+        if (data != MAP_FAILED)
+            munmap(data, size);
+        close(fd);
+        return retval;
+}
+
+/* Every worker fills its band of rows, straight into the words of the
+ * bitwise engine or one object at a time into the table. */
+static void
+soup_job(void *data, int worker) {
+    struct soup_job *job = data;
+    struct gol *g = job->g;
+    int from, to;
+    workers_band(g->workers, worker, g->rows, &from, &to);
+    for (int y = from; y < to; y++) {
+        const uint64_t first = (uint64_t) y * job->words;
+        if (g->bits) {
+            uint64_t *row = bitgrid_row(g->bits, y);
+            for (int w = 0; w < job->words; w++)
+                row[w] = soup_word(&job->soup, first + w);
+            row[job->words - 1] &= g->bits->tail_mask;
+            continue;
+        }
+        bool *objects = g->table + (size_t) y * g->columns;
+        for (int w = 0; w < job->words; w++) {
+            const uint64_t word = soup_word(&job->soup, first + w);
+            const int x = w * 64;
+            const int n = g->columns - x < 64 ? g->columns - x : 64;
+            for (int i = 0; i < n; i++)
+                objects[x + i] = word >> i & 1;
+        }
+    }
+}
+
+/* Fills the table at random, the same way for a seed whatever the engine and
+ * the number of threads. */
+static bool
+generate_table(struct gol *g, const struct options_opts *opts, bool bitwise) {
+    g->rows = opts->rows;
+    g->columns = opts->columns;
+    if (bitwise) {
+        g->bits = bitgrid_init(g->rows, g->columns, g->rule, g->torus);
+        if (!g->bits)
+            return false;
+    }
+    else {
+        g->table = gol_allocate_table((size_t) g->rows * g->columns);
+        if (!g->table)
+            return false;
+    }
+
+    g->seed = opts->seed ? opts->seed : (uint64_t) time(NULL);
+    struct soup_job job = { .g = g, .words = (g->columns + 63) / 64 };
+    soup_init(&job.soup, g->seed, opts->probability);
+    workers_run(g->workers, soup_job, &job);
+    if (g->bits)
+        bitgrid_rows_written(g->bits);
+    return true;
+}
+
+static void
+free_table(struct gol *g) {
+    free(g->table);
+    free(g->next_table);
+    g->table = NULL;
+    g->next_table = NULL;
+}
+
+static bool
+table_to_bitgrid(struct gol *g) {
+    g->bits = bitgrid_init(g->rows, g->columns, g->rule, g->torus);
+    if (!g->bits)
+        return false;
+    for (int y = 0; y < g->rows; y++) {
+        for (int x = 0; x < g->columns; x++)
+            bitgrid_set(g->bits, y, x, g->table[offset(g, y, x)]);
+    }
+    free_table(g);
+    return true;
+}
+
+/* Moves the table into one with a border of ghost objects around it, which
+ * the scalar engine counts as neighbors without bounds checks. The border
+ * stays dead, or on a torus gets copies of the opposite edge. */
+static bool
+pad_table(struct gol *g) {
+    const size_t objects = (size_t) (g->rows + 2) * (g->columns + 2);
+    bool *table = gol_allocate_table(objects);
+    bool *next = gol_allocate_table(objects);
+    if (!table || !next) {
+        free(table);
+        free(next);
+        return false;
+    }
+    memset(table, 0, objects * sizeof(bool));
+    memset(next, 0, objects * sizeof(bool));
+    for (int y = 0; y < g->rows; y++) {
+        memcpy(table + (size_t) (y + 1) * (g->columns + 2) + 1,
+            g->table + (size_t) y * g->columns, g->columns * sizeof(bool));
+    }
+    free_table(g);
+    g->table = table;
+    g->next_table = next;
+    g->padded = true;
+    return true;
+}
+
+static bool
+table_to_hashlife(struct gol *g) {
+    g->life = hashlife_init(g->table, g->rows, g->columns, g->rule,
+        HASHLIFE_MAX_NODES);
+    if (!g->life)
+        return false;
+    free_table(g);
+    return true;
+}
+
+static bool
+table_to_sparse(struct gol *g) {
+    g->sparse = sparse_init(g->rule);
+    if (!g->sparse)
+        return false;
+    for (int y = 0; y < g->rows; y++) {
+        for (int x = 0; x < g->columns; x++) {
+            if (g->table[offset(g, y, x)] && !sparse_set(g->sparse, y, x, true))
+                return false;
+        }
+    }
+    free_table(g);
+    return true;
+}
+
+/* Copies the edges of the rows from to to into the ghost objects on the
+ * opposite side of the torus. The first and the last row are copied into
+ * the ghost rows too, by the worker that has them. */
+static void
+fill_ghosts(const struct gol *g, bool *table, int from, int to) {
+    for (int y = from; y < to; y++) {
+        bool *row = table + offset(g, y, 0);
+        row[-1] = row[g->columns - 1];
+        row[g->columns] = row[0];
+    }
+    const size_t row_size = (g->columns + 2) * sizeof(bool);
+    if (from == 0 && from < to) {
+        memcpy(table + offset(g, g->rows, -1), table + offset(g, 0, -1),
+            row_size);
+    }
+    if (to == g->rows && from < to) {
+        memcpy(table + offset(g, -1, -1), table + offset(g, g->rows - 1, -1),
+            row_size);
+    }
+}
+
+static void
+step_job(void *data, int worker) {
+    struct step_job *job = data;
+    struct gol *g = job->g;
+    const int workers = workers_count(g->workers);
+    int from, to;
+    workers_band(g->workers, worker, g->rows, &from, &to);
+
+    bool *table = g->table, *next = g->next_table;
+    long generation = 0, objects_moved = 0;
+    if (g->torus) {
+        fill_ghosts(g, table, from, to);
+        workers_sync(g->workers);
+    }
+    while (generation < job->n) {
+        long *counts = job->objects_moved + (generation % 2) * workers;
+        uint64_t *hashes = job->hashes + (generation % 2) * workers;
+        hashes[worker] = 0;
+        counts[worker] = step_rows(g, table, next, from, to,
+            g->cycle ? &hashes[worker] : NULL);
+        if (g->torus)
+            fill_ghosts(g, next, from, to);
+        workers_sync(g->workers);
+        if (worker == 0) {
+            for (int i = 0; i < workers; i++)
+                g->hash ^= hashes[i];
+        }
+
+        bool *temp = table;
+        table = next;
+        next = temp;
+        generation++;
+
+        objects_moved = 0;
+        for (int i = 0; i < workers; i++)
+            objects_moved += counts[i];
+        if (!objects_moved && job->until_stable)
+            break;
+    }
+
+    if (worker == 0) {
+        g->table = table;
+        g->next_table = next;
+        job->generations = generation;
+        job->last_objects_moved = objects_moved;
+    }
+}
+
+static long
+step_scalar(struct gol *g, long n, bool until_stable, long *objects_moved) {
+    long counts[2 * workers_count(g->workers)];
+    uint64_t hashes[2 * workers_count(g->workers)];
+    struct step_job job = {
+        .g = g, .n = n, .until_stable = until_stable,
+        .objects_moved = counts, .hashes = hashes
+    };
+    workers_run(g->workers, step_job, &job);
+    *objects_moved = job.last_objects_moved;
+    return job.generations;
+}
+
+static bool
+get_scalar(const struct gol *g, int y, int x) {
+    return g->table[offset(g, y, x)];
+}
+
+static long
+population_scalar(const struct gol *g) {
+    long population = 0;
+    for (int y = 0; y < g->rows; y++) {
+        const bool *objects = gol_row(g, y);
+        for (int x = 0; x < g->columns; x++)
+            population += objects[x];
+    }
+    return population;
+}
+
+static long
+count_scalar(const struct gol *g, long y, long x, long rows, long columns) {
+    long count = 0;
+    for (long cy = y > 0 ? y : 0; cy < y + rows && cy < g->rows; cy++) {
+        for (long cx = x > 0 ? x : 0; cx < x + columns && cx < g->columns;
+                cx++)
+            count += g->table[offset(g, cy, cx)];
+    }
+    return count;
+}
+
+static void
+span_scalar(const struct gol *g, long y, long x, long columns,
+            uint64_t *words) {
+    memset(words, 0, sizeof(*words) * ((columns + 63) / 64));
+    if (y < 0 || y >= g->rows)
+        return;
+    const bool *objects = gol_row(g, y);
+    const long from = x > 0 ? x : 0;
+    const long to = x + columns < g->columns ? x + columns : g->columns;
+    for (long cx = from; cx < to; cx++)
+        words[(cx - x) / 64] |= (uint64_t) objects[cx] << ((cx - x) % 64);
+}
+
+static bool
+bounds_scalar(const struct gol *g, long *top, long *left, long *bottom,
+              long *right) {
+    for (int y = 0; y < g->rows; y++) {
+        const bool *objects = gol_row(g, y);
+        int first = 0, last = g->columns;
+        while (first < last && !objects[first])
+            first++;
+        if (first == last)
+            continue;
+        while (!objects[last - 1])
+            last--;
+        if (y < *top)
+            *top = y;
+        *bottom = y + 1;
+        if (first < *left)
+            *left = first;
+        if (last > *right)
+            *right = last;
+    }
+    return *top < *bottom;
+}
+
+static void
+track_hash_scalar(struct gol *g) {
+    g->hash = table_hash(g);
+}
+
+static uint64_t
+hash_scalar(const struct gol *g) {
+    return g->hash;
+}
+
+static bool
+init_bitwise(struct gol *g) {
+    // A checkpoint or a recording may have been loaded straight into one.
+    return g->bits || table_to_bitgrid(g);
+}
+
+static void
+free_bitwise(struct gol *g) {
+    bitgrid_free(g->bits);
+    g->bits = NULL;
+}
+
+static long
+step_bitwise(struct gol *g, long n, bool until_stable, long *objects_moved) {
+    return bitgrid_step(g->bits, g->workers, n, until_stable, objects_moved);
+}
+
+static bool
+get_bitwise(const struct gol *g, int y, int x) {
+    return bitgrid_get(g->bits, y, x);
+}
+
+static long
+population_bitwise(const struct gol *g) {
+    return bitgrid_population(g->bits);
+}
+
+static long
+count_bitwise(const struct gol *g, long y, long x, long rows, long columns) {
+    return bitgrid_count(g->bits, y, x, rows, columns);
+}
+
+static void
+span_bitwise(const struct gol *g, long y, long x, long columns,
+             uint64_t *words) {
+    bitgrid_span(g->bits, y, x, columns, words);
+}
+
+static bool
+bounds_bitwise(const struct gol *g, long *top, long *left, long *bottom,
+               long *right) {
+    return bitgrid_bounds(g->bits, top, left, bottom, right);
+}
+
+static void
+track_hash_bitwise(struct gol *g) {
+    bitgrid_track_hash(g->bits);
+}
+
+static uint64_t
+hash_bitwise(const struct gol *g) {
+    return g->bits->hash;
+}
+
+static void
+free_hashlife(struct gol *g) {
+    hashlife_free(g->life);
+    g->life = NULL;
+}
+
+/* Hashlife only tells whether anything moved. Unless it has to stop when
+ * nothing moves, it jumps all the generations at once. */
+static long
+step_hashlife(struct gol *g, long n, bool until_stable, long *objects_moved) {
+    bool changed;
+    if (!until_stable) {
+        if (!hashlife_step(g->life, n, &changed))
+            return -1;
+        *objects_moved = changed;
+        return n;
+    }
+    long generation = 0;
+    while (generation < n) {
+        generation++;
+        if (!hashlife_step(g->life, 1, &changed))
+            return -1;
+        if (!(*objects_moved = changed))
+            break;
+    }
+    return generation;
+}
+
+static bool
+get_hashlife(const struct gol *g, int y, int x) {
+    return hashlife_get(g->life, y, x);
+}
+
+static long
+population_hashlife(const struct gol *g) {
+    return hashlife_population(g->life);
+}
+
+static long
+count_hashlife(const struct gol *g, long y, long x, long rows, long columns) {
+    return hashlife_count(g->life, y, x, rows, columns);
+}
+
+static void
+span_hashlife(const struct gol *g, long y, long x, long columns,
+              uint64_t *words) {
+    hashlife_span(g->life, y, x, columns, words);
+}
+
+static bool
+bounds_hashlife(const struct gol *g, long *top, long *left, long *bottom,
+                long *right) {
+    return hashlife_bounds(g->life, top, left, bottom, right);
+}
+
+static uint64_t
+hash_hashlife(const struct gol *g) {
+    return hashlife_hash(g->life);
+}
+
+static void
+free_sparse(struct gol *g) {
+    sparse_free(g->sparse);
+    g->sparse = NULL;
+}
+
+static long
+step_sparse(struct gol *g, long n, bool until_stable, long *objects_moved) {
+    return sparse_step(g->sparse, g->workers, n, until_stable, objects_moved);
+}
+
+static bool
+get_sparse(const struct gol *g, int y, int x) {
+    return sparse_get(g->sparse, y, x);
+}
+
+static long
+population_sparse(const struct gol *g) {
+    return sparse_population(g->sparse);
+}
+
+static long
+count_sparse(const struct gol *g, long y, long x, long rows, long columns) {
+    return sparse_count(g->sparse, y, x, rows, columns);
+}
+
+static void
+span_sparse(const struct gol *g, long y, long x, long columns,
+            uint64_t *words) {
+    sparse_span(g->sparse, y, x, columns, words);
+}
+
+static bool
+bounds_sparse(const struct gol *g, long *top, long *left, long *bottom,
+              long *right) {
+    return sparse_bounds(g->sparse, top, left, bottom, right);
+}
+
+static void
+track_hash_sparse(struct gol *g) {
+    sparse_track_hash(g->sparse);
+}
+
+static uint64_t
+hash_sparse(const struct gol *g) {
+    return sparse_hash(g->sparse);
+}
+
+static const struct gol_engine engines[] = {
+    [OPTIONS_ENGINE_BITWISE] = {
+        "bitwise", true, init_bitwise, free_bitwise, step_bitwise,
+        get_bitwise, population_bitwise, count_bitwise, span_bitwise,
+        bounds_bitwise, track_hash_bitwise, hash_bitwise
+    },
+    [OPTIONS_ENGINE_SCALAR] = {
+        "scalar", true, pad_table, free_table, step_scalar, get_scalar,
+        population_scalar, count_scalar, span_scalar, bounds_scalar,
+        track_hash_scalar, hash_scalar
+    },
+    [OPTIONS_ENGINE_HASHLIFE] = {
+        "hashlife", false, table_to_hashlife, free_hashlife, step_hashlife,
+        get_hashlife, population_hashlife, count_hashlife, span_hashlife,
+        bounds_hashlife, NULL, hash_hashlife
+    },
+    [OPTIONS_ENGINE_SPARSE] = {
+        "sparse", false, table_to_sparse, free_sparse, step_sparse,
+        get_sparse, population_sparse, count_sparse, span_sparse,
+        bounds_sparse, track_hash_sparse, hash_sparse
+    }
+};
 
-        for (int x = 0; x < opts->columns; x++) {
-             g->table[y][x].alive_this_round =
-                 is_object_alive_at_start(opts->probability);
-             g->table[y][x].alive_next_round = false; 
+/* Copies the table of the engine into a table of the scalar engine, which
+ * is then stepped alongside it. */
+static bool
+start_verifying(struct gol *g) {
+    struct gol *r = malloc(sizeof(*r));
+    if (!r)
+        return false;
+    memset(r, 0, sizeof(*r));
+    g->reference = r;
+    r->engine = &engines[OPTIONS_ENGINE_SCALAR];
+    r->workers = g->workers;
+    r->rows = g->rows;
+    r->columns = g->columns;
+    r->rule = g->rule;
+    r->torus = g->torus;
+    r->table = gol_allocate_table((size_t) r->rows * r->columns);
+    if (!r->table)
+        return false;
+    uint64_t words[(r->columns + 63) / 64];
+    for (int y = 0; y < r->rows; y++) {
+        gol_span(g, y, 0, r->columns, words);
+        for (int x = 0; x < r->columns; x++)
+            r->table[(size_t) y * r->columns + x] =
+                (words[x / 64] >> (x % 64)) & 1;
+    }
+    return r->engine->init(r);
+}
+
+/* Steps the reference the generations the engine just did, and remembers
+ * the first object in which they differ. */
+static void
+verify(struct gol *g, long generations) {
+    struct gol *r = g->reference;
+    long objects_moved;
+    r->engine->step(r, generations, false, &objects_moved);
+    const int words = (g->columns + 63) / 64;
+    uint64_t cells[words], reference[words];
+    for (int y = 0; y < g->rows; y++) {
+        gol_span(g, y, 0, g->columns, cells);
+        gol_span(r, y, 0, g->columns, reference);
+        for (int w = 0; w < words; w++) {
+            const uint64_t diff = cells[w] ^ reference[w];
+            if (diff) {
+                g->diverged = g->generation;
+                g->diverged_y = y;
+                g->diverged_x = w * 64 + __builtin_ctzll(diff);
+                return;
+            }
         }
     }
+}
+
+/* Prints why the engine stopped the run, if it did. Returns false if it
+ * did. */
+static bool
+report_engine(const struct gol *g) {
+    if (g->failed && g->slabs) {
+        fprintf(stderr, "a slab process failed after generation %ld\n",
+            g->generation);
+    }
+    else if (g->failed) {
+        fprintf(stderr, "the %s engine ran out of memory after generation "
+            "%ld\n", g->engine->name, g->generation);
+    }
+    else if (g->diverged) {
+        fprintf(stderr, "the %s engine diverged from the reference in "
+            "generation %ld: the object in row %d, column %d is %s\n",
+            g->engine->name, g->diverged, g->diverged_y, g->diverged_x,
+            gol_is_alive(g, g->diverged_y, g->diverged_x) ? "alive" :
+                                                            "dead");
+    }
+    return !g->failed && !g->diverged;
+}
+
+/* Advances at most n generations. With until_stable, stops after a generation
+ * in which no object moved. Returns the number of generations advanced, or
+ * -1 if the engine failed. */
+static long
+step_engine(struct gol *g, long n, bool until_stable, long *objects_moved) {
+    if (g->replay)
+        return replay_step(g->replay, g, n, objects_moved);
+    if (g->slabs)
+        return slabs_step(g->slabs, n, until_stable, objects_moved);
+    return g->engine->step(g, n, until_stable, objects_moved);
+}
+
+/* Prints the stats when SIGUSR1 asks for them and into the JSON lines
+ * when it's time. On the stepping thread, which is the one that may look at
+ * the table. */
+static void
+print_stats_when_asked(struct gol *g) {
+    if (stats_signaled())
+        stats_print(g->stats, stderr, g->generation, gol_population(g));
+    if (g->stats_json && g->generation % g->stats_every == 0) {
+        stats_print_json(g->stats, g->stats_json, g->generation,
+            gol_population(g));
+    }
+}
+
+/* Generations stepped at once when verifying: one, or a block when the
+ * bitwise engine steps in blocks, so that those are verified too. */
+static long
+verified_at_once(const struct gol *g) {
+    return g->bits && g->bits->block > 1 ? g->bits->block : 1;
+}
+
+/* Steps like step_engine(), stopping at every checkpoint to copy the table
+ * for the writer, and every stats_every generations to append the stats
+ * to stats_json. Every call of the engine is timed as a whole. When recorded,
+ * generations are stepped one by one. Stops when the engine fails or
+ * diverges from the reference. */
+static long
+step(struct gol *g, long n, bool until_stable, long *objects_moved) {
+    const long every = g->checkpoint_every;
+    long generations = 0;
+    while (generations < n) {
+        long chunk = g->recorder ? 1 : n - generations;
+        if (g->reference && chunk > verified_at_once(g))
+            chunk = verified_at_once(g);
+        if (every && chunk > every - g->generation % every)
+            chunk = every - g->generation % every;
+        if (g->stats_json &&
+                chunk > g->stats_every - g->generation % g->stats_every)
+            chunk = g->stats_every - g->generation % g->stats_every;
+        const uint64_t start = g->stats ? stats_now() : 0;
+        const long stepped = step_engine(g, chunk, until_stable,
+            objects_moved);
+        if (stepped < 0) {
+            g->failed = true;
+            break;
+        }
+        generations += stepped;
+        g->generation += stepped;
+        if (g->reference && stepped) {
+            verify(g, stepped);
+            if (g->diverged)
+                break;
+        }
+        if (g->recorder && stepped)
+            recorder_add(g->recorder, g);
+        if (g->stats) {
+            stats_time(g->stats, STATS_STEP, start);
+            stats_count(g->stats, stepped,
+                (long long) stepped * g->rows * g->columns, *objects_moved);
+        }
+        if (every && g->generation % every == 0) {
+            const uint64_t start = g->stats ? stats_now() : 0;
+            if (!snapshot_checkpoint(g->checkpoints, g)) {
+                fprintf(stderr, "checkpoint of generation %ld skipped, the "
+                    "last one is still being written\n", g->generation);
+            }
+            if (g->stats)
+                stats_time(g->stats, STATS_CHECKPOINT, start);
+        }
+        if (g->stats)
+            print_stats_when_asked(g);
+        if (stepped < chunk || (until_stable && !*objects_moved))
+            break;
+    }
+    return generations;
+}
+
+static uint64_t
+hash(const struct gol *g) {
+    return g->engine->hash(g);
+}
+
+static bool
+start_looking_for_cycles(struct gol *g, int window) {
+    g->cycle = cycle_init(window);
+    if (!g->cycle) {
+        fprintf(stderr, "memory error\n");
+        return false;
+    }
+    if (g->engine->track_hash)
+        g->engine->track_hash(g);
+    long period;
+    cycle_add(g->cycle, 0, hash(g), &period);
+    return true;
+}
+
+/* Remembers the table of a generation and returns true if it was seen in
+ * the window before. */
+static bool
+found_cycle(struct gol *g, long generation) {
+    long period;
+    if (!cycle_add(g->cycle, generation, hash(g), &period))
+        return false;
+    g->period = period;
+    g->cycle_start = generation - period;
     return true;
 }
 
@@ -260,85 +1078,450 @@ gol_init(const struct options_opts *opts) {
     if (!g)
         return NULL;
     memset(g, 0, sizeof(*g));
+    g->engine = &engines[opts->engine];
 
+    g->workers = workers_init(opts->threads);
+    if (!g->workers) {
+        fprintf(stderr, "can't start threads\n");
+        goto error;
+    }
+    g->generations = opts->generations;
+    g->display = !opts->no_display;
+    g->delta = opts->delta;
+    g->speed = opts->speed;
     g->alive_character = opts->alive_character;
     g->not_alive_character = opts->not_alive_character;
 
-    if (opts->file) {
+    g->rule = RULE_CONWAY;
+    g->torus = opts->topology == OPTIONS_TOPOLOGY_TORUS;
+
+    bool mapped = false;
+    enum options_format format = OPTIONS_FORMAT_PLAIN;
+    if (opts->resume) {
+        if (!snapshot_load(opts->resume, g,
+                opts->engine == OPTIONS_ENGINE_BITWISE,
+                opts->rule_set ? &opts->rule : NULL))
+            goto error;
+    }
+    else if (opts->replay) {
+        g->replay = replay_init(opts->replay, g, opts->seek);
+        if (!g->replay)
+            goto error;
+    }
+    else if (opts->file) {
+        format = opts->format == OPTIONS_FORMAT_AUTO ?
+            pattern_guess_format(opts->file) : opts->format;
+        if (format == OPTIONS_FORMAT_PLAIN &&
+                !map_table(opts->file, g, &mapped))
+            goto error;
+    }
+
+    if (opts->file && !mapped) {
         errno = 0;
         FILE *fp = open_file(opts->file);
         if (!fp)
-            return NULL;
-        if (!read_table(fp, g)) {
+            goto error;
+        bool ok = format == OPTIONS_FORMAT_PLAIN ? read_table(fp, g) :
+                                                   pattern_read(fp, format, g);
+        if (!ok) {
             close_file(fp, opts->file);
-            return NULL;
+            goto error;
         }
         close_file(fp, opts->file);
     }
-    else {
-        if (!generate_table(g, opts))
-            return NULL;
-        g->rows = opts->rows;
-        g->columns = opts->columns;
+    // The rule of a pattern file is only a default.
+    if (opts->rule_set)
+        g->rule = opts->rule;
+    if ((g->rule.birth & 1) && !g->engine->bounded) {
+        fprintf(stderr, "rules with B0 need the bitwise or scalar engine\n");
+        goto error;
+    }
+    if (g->torus && !g->engine->bounded) {
+        fprintf(stderr, "topology torus needs the bitwise or scalar engine\n");
+        goto error;
+    }
+    if (!opts->file && !opts->resume && !opts->replay &&
+            !generate_table(g, opts, opts->engine == OPTIONS_ENGINE_BITWISE)) {
+        fprintf(stderr, "memory error\n");
+        goto error;
+    }
+
+    if (!g->engine->init(g)) {
+        fprintf(stderr, "memory error\n");
+        goto error;
+    }
+    if (g->bits)
+        g->bits->block = opts->block;
+
+    // The processes are forked before the threads of the recorder and the
+    // checkpoint writer start. The workers are idle then, and a child only
+    // has this thread and starts workers of its own, never touching the
+    // ones it was forked with or any lock they may hold.
+    if (opts->processes > 1) {
+        g->slabs = slabs_init(g->bits, opts->processes, opts->threads);
+        if (!g->slabs)
+            goto error;
+    }
+    if (opts->verify && !start_verifying(g)) {
+        fprintf(stderr, "memory error\n");
+        goto error;
+    }
+    if (opts->record) {
+        g->recorder = recorder_init(opts->record, g);
+        if (!g->recorder)
+            goto error;
+    }
+    if (opts->cycle_window && !start_looking_for_cycles(g, opts->cycle_window))
+        goto error;
+    if (opts->checkpoint_every) {
+        g->checkpoints = snapshot_writer_init(opts->checkpoint ?
+            opts->checkpoint : DEFAULT_CHECKPOINT_FILE);
+        if (!g->checkpoints) {
+            fprintf(stderr, "can't start the checkpoint writer\n");
+            goto error;
+        }
+        g->checkpoint_every = opts->checkpoint_every;
+    }
+    if (opts->stats || opts->stats_json) {
+        g->stats = stats_init();
+        if (!g->stats) {
+            fprintf(stderr, "memory error\n");
+            goto error;
+        }
+        if (!stats_catch_signal())
+            fprintf(stderr, "can't catch SIGUSR1, stats only at exit\n");
+        g->stats_at_exit = opts->stats;
+        g->stats_every = opts->stats_every;
+    }
+    if (opts->stats_json) {
+        g->stats_json = fopen(opts->stats_json, "a");
+        if (!g->stats_json) {
+            fprintf(stderr, "can't open %s\n", opts->stats_json);
+            goto error;
+        }
     }
-    
     return g;
+
+    error:
+        gol_free(g);
+        return NULL;
 }
 
 void
 gol_free(struct gol *g) {
     if (!g)
         return;
-    if (!g->table)
-        goto free_g;
-    for (int y = 0; y < g->rows; y++) {
-        if (g->table[y])
-            free(g->table[y]);
+    snapshot_writer_free(g->checkpoints);
+    recorder_free(g->recorder);
+    replay_free(g->replay);
+    slabs_free(g->slabs);
+    free_table(g);
+    g->engine->free(g);
+    if (g->reference) {
+        g->reference->engine->free(g->reference);
+        free(g->reference);
     }
-    free(g->table);
-   
-    free_g:
-        free(g);
+    workers_free(g->workers);
+    cycle_free(g->cycle);
+    stats_free(g->stats);
+    if (g->stats_json)
+        fclose(g->stats_json);
+    free(g);
 }
 
-void
+static double
+seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) +
+        (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void
+print_report(const struct gol *g, long generations, double seconds) {
+    double per_second = seconds > 0 ? generations / seconds : 0;
+    printf("generations: %ld\n", generations);
+    printf("wall time: %.3f s\n", seconds);
+    printf("generations/s: %.1f\n", per_second);
+    printf("cells/s: %.4g\n", per_second * g->rows * g->columns);
+    printf("population: %ld\n", gol_population(g));
+    if (g->seed)
+        printf("seed: %llu\n", (unsigned long long) g->seed);
+    if (g->period) {
+        printf("period: %ld\n", g->period);
+        printf("cycle start: %ld\n", g->cycle_start);
+    }
+}
+
+/* Steps one generation at a time until a cycle is found. Every generation
+ * repeating the one before it is a cycle too, so this also stops when the
+ * table is stable. */
+static long
+step_until_cycle(struct gol *g, long n) {
+    long generation = 0, objects_moved;
+    // A recording played back ends, and the engine may fail.
+    while (generation < n && step(g, 1, false, &objects_moved)) {
+        if (found_cycle(g, ++generation) || g->diverged)
+            break;
+    }
+    return generation;
+}
+
+static bool
+run_headless(struct gol *g) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    long objects_moved, generation;
+    if (g->cycle)
+        generation = step_until_cycle(g, g->generations ? g->generations :
+                                                           LONG_MAX);
+    else {
+        generation = step(g, g->generations ? g->generations : LONG_MAX,
+            !g->generations, &objects_moved);
+    }
+
+    print_report(g, generation, seconds_since(&start));
+    if (g->stats_at_exit)
+        stats_print(g->stats, stdout, g->generation, gol_population(g));
+    return report_engine(g);
+}
+
+/* Every worker takes the next soup that nobody has yet, so one that runs
+ * long holds up only its own worker. A soup is stepped on the worker's
+ * thread alone. */
+static void
+search_job(void *data, int worker) {
+    (void) worker;
+    struct search_job *job = data;
+    struct options_opts opts = *job->opts;
+    opts.threads = 1;
+    long soup;
+    while ((soup = atomic_fetch_add(&job->next, 1)) < job->opts->soups &&
+            !atomic_load(&job->failed)) {
+        opts.seed = job->first_seed + soup;
+        struct gol *g = gol_init(&opts);
+        if (!g) {
+            atomic_store(&job->failed, true);
+            return;
+        }
+        const long generation = step_until_cycle(g, g->generations ?
+            g->generations : LONG_MAX);
+        if (!report_engine(g)) {
+            atomic_store(&job->failed, true);
+            gol_free(g);
+            return;
+        }
+        // One call writes the whole line, so lines don't mix.
+        if (g->period) {
+            printf("%llu %ld %ld %ld\n", (unsigned long long) g->seed,
+                g->cycle_start, gol_population(g), g->period);
+        }
+        else {
+            printf("%llu %ld %ld -\n", (unsigned long long) g->seed,
+                generation, gol_population(g));
+        }
+        gol_free(g);
+    }
+}
+
+bool
+gol_search(const struct options_opts *opts) {
+    struct workers *w = workers_init(opts->threads);
+    if (!w) {
+        fprintf(stderr, "can't start threads\n");
+        return false;
+    }
+    struct search_job job = {
+        .opts = opts,
+        .first_seed = opts->seed ? opts->seed : (uint64_t) time(NULL)
+    };
+    atomic_init(&job.next, 0);
+    atomic_init(&job.failed, false);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    printf("seed generations population period\n");
+    workers_run(w, search_job, &job);
+    const double seconds = seconds_since(&start);
+    workers_free(w);
+    if (atomic_load(&job.failed))
+        return false;
+
+    printf("soups: %d\n", opts->soups);
+    printf("wall time: %.3f s\n", seconds);
+    printf("soups/s: %.1f\n", seconds > 0 ? opts->soups / seconds : 0);
+    return true;
+}
+
+/* Steps a generation on the screen. The game is over after the generations
+ * asked for, or when it's stable if none were, or when a cycle is found. */
+static bool
+step_displayed(struct gol *g, void *data) {
+    long *generation = data, objects_moved;
+    if (g->generations && *generation == g->generations)
+        return false;
+    // A recording played back ends.
+    if (!step(g, 1, false, &objects_moved) || g->failed || g->diverged)
+        return false;
+    ++*generation;
+    if (!objects_moved && !g->generations)
+        return false;
+    return !(g->cycle && found_cycle(g, *generation));
+}
+
+bool
 gol_run(struct gol *g) {
-    int objects_moved = 0;
-    long wait = WAIT_NSECS;
+    if (!g->display)
+        return run_headless(g);
+
+    long generation = 0;
+    struct frame_view view = { 0, 0, g->rows, g->columns, 0, false };
     #ifdef HAVE_NCURSES
-        if (!ncurses_init(g))
-            return;
+        if (!ncurses_init(g, &view))
+            return false;
+    #else
+        struct terminal *t = terminal_init(g, g->delta);
+        if (!t) {
+            fprintf(stderr, "memory error\n");
+            return false;
+        }
     #endif
+    struct display *d = display_init(g, step_displayed, &generation, &view,
+        g->speed);
+    if (!d) {
+        #ifdef HAVE_NCURSES
+            ncurses_end();
+        #else
+            terminal_free(t);
+        #endif
+        fprintf(stderr, "can't start stepping\n");
+        return false;
+    }
     while (true) {
+        const bool finished = display_finished(d);
+        const struct frame *f = display_frame(d);
+        uint64_t start = g->stats ? stats_now() : 0;
         #ifdef HAVE_NCURSES
-            ncurses_draw(g);
-            if (ncurses_handle_key(&wait) == NCURSES_QUIT)
+            if (f)
+                ncurses_draw(g, f);
+            if (g->stats && f) {
+                stats_time(g->stats, STATS_DRAW, start);
+                start = stats_now();
+            }
+            if (finished)
+                break;
+            const enum ncurses_return_value key = ncurses_handle_key(g, d);
+            if (g->stats)
+                stats_time(g->stats, STATS_KEYS, start);
+            if (key == NCURSES_QUIT)
                 break;
         #else
-            system("clear");
-            gol_foreach_object(g, print_cb, NULL);
+            if (f)
+                terminal_draw(t, f);
+            if (g->stats && f) {
+                stats_time(g->stats, STATS_DRAW, start);
+                start = stats_now();
+            }
+            if (finished)
+                break;
+            gol_sleep(1000000000L / DISPLAY_FRAMES_PER_SECOND);
+            if (g->stats)
+                stats_time(g->stats, STATS_WAIT, start);
         #endif
-        gol_foreach_object(g, set_alive_next_round_cb, NULL);
-        gol_foreach_object(g, set_alive_this_round_cb, &objects_moved);
-        if (!objects_moved)
-            break;
-        objects_moved = 0;
-        gol_sleep(wait);
     }
+    const bool failed = display_failed(d);
+    display_free(d);
     #ifdef HAVE_NCURSES
         ncurses_end();
+    #else
+        terminal_free(t);
     #endif
+    if (failed)
+        fprintf(stderr, "memory error\n");
+    if (g->period) {
+        printf("cycle of period %ld from generation %ld\n", g->period,
+            g->cycle_start);
+    }
+    if (g->stats_at_exit)
+        stats_print(g->stats, stdout, g->generation, gol_population(g));
+    return report_engine(g) && !failed;
 }
 
-void
-gol_foreach_object(struct gol *g, callback cb, void *data) {
-    for (int y = 0; y < g->rows; y++) {
-        for (int x = 0; x < g->columns; x++) {
-            cb(g, data, y, x);
-        }
+bool
+gol_is_bounded(const struct gol *g) {
+    return g->engine->bounded;
+}
+
+long
+gol_count(const struct gol *g, long y, long x, long rows, long columns) {
+    return g->engine->count(g, y, x, rows, columns);
+}
+
+const bool*
+gol_row(const struct gol *g, int y) {
+    return g->table + offset(g, y, 0);
+}
+
+long
+gol_population(const struct gol *g) {
+    return g->engine->population(g);
+}
+
+bool
+gol_is_alive(const struct gol *g, int y, int x) {
+    return g->engine->get(g, y, x);
+}
+
+/* Packs the objects of a row into words, of one table or XORed with
+ * another. */
+static void
+pack_row(const struct gol *g, const bool *table, const bool *other, int y,
+         uint64_t *words) {
+    const bool *objects = table + offset(g, y, 0);
+    const bool *others = other ? other + offset(g, y, 0) : NULL;
+    for (int w = 0; w < (g->columns + 63) / 64; w++)
+        words[w] = 0;
+    for (int x = 0; x < g->columns; x++) {
+        words[x / 64] |= (uint64_t) (objects[x] ^ (others ? others[x] : 0)) <<
+            (x % 64);
     }
 }
 
+const uint64_t*
+gol_row_words(const struct gol *g, int y, uint64_t *words) {
+    if (g->bits)
+        return bitgrid_row(g->bits, y);
+    pack_row(g, g->table, NULL, y, words);
+    return words;
+}
+
+bool
+gol_row_flips(const struct gol *g, int y, uint64_t *flips) {
+    if (g->bits)
+        return bitgrid_row_flips(g->bits, y, flips);
+    pack_row(g, g->table, g->next_table, y, flips);
+    return true;
+}
+
+void
+gol_span(const struct gol *g, long y, long x, long columns, uint64_t *words) {
+    g->engine->span(g, y, x, columns, words);
+}
+
+bool
+gol_bounding_box(const struct gol *g, struct gol_box *box) {
+    long top = g->rows, left = g->columns, bottom = 0, right = 0;
+    const bool any = g->engine->bounds(g, &top, &left, &bottom, &right);
+    if (!any)
+        return false;
+    box->y = top;
+    box->x = left;
+    box->rows = bottom - top;
+    box->columns = right - left;
+    return true;
+}
+
 void
 gol_sleep(long wait) {
     const struct timespec t = { .tv_sec = 0, .tv_nsec = wait };
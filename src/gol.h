@@ -1,37 +1,189 @@
 #ifndef GOL_H
     #define GOL_H
 #include "options.h"
+#include "bitgrid.h"
+#include "hashlife.h"
+#include "sparse.h"
+#include "cycle.h"
+#include "rule.h"
+#include "stats.h"
+#include "workers.h"
 #include <stdbool.h>
+#include <stdint.h>
 #ifdef HAVE_NCURSES
     #include <curses.h>
 #endif
 
-struct object {
-    bool alive_this_round, alive_next_round;
+struct snapshot_writer;
+struct recorder;
+struct replay;
+struct slabs;
+struct gol;
+
+/* The operations of an engine, on the table in a representation of its own
+ * kept in struct gol. The scalar engine keeps it the simplest way, and the
+ * others are verified against it. */
+struct gol_engine {
+    const char *name;
+    // Whether the table has edges. Otherwise objects can be looked at
+    // anywhere.
+    bool bounded;
+    // Takes the table read or generated row after row over, freeing it.
+    bool (*init)(struct gol *g);
+    void (*free)(struct gol *g);
+    // Advances at most n generations. With until_stable, stops after a
+    // generation in which no object moved. Returns the number of
+    // generations advanced, or -1 when out of memory.
+    long (*step)(struct gol *g, long n, bool until_stable,
+                 long *objects_moved);
+    bool (*get)(const struct gol *g, int y, int x);
+    long (*population)(const struct gol *g);
+    long (*count)(const struct gol *g, long y, long x, long rows,
+                  long columns);
+    void (*span)(const struct gol *g, long y, long x, long columns,
+                 uint64_t *words);
+    bool (*bounds)(const struct gol *g, long *top, long *left, long *bottom,
+                   long *right);
+    // Starts keeping the hash of the table up to date, NULL if it always
+    // is.
+    void (*track_hash)(struct gol *g);
+    uint64_t (*hash)(const struct gol *g);
 };
 
 struct gol {
-    struct object **table;
+    const struct gol_engine *engine;
+    // Objects of this and the next round, row after row. Swapped each round.
+    bool *table, *next_table;
+    // Set when the bitwise, hashlife or sparse engine is used. The table is
+    // freed then.
+    struct bitgrid *bits;
+    struct hashlife *life;
+    struct sparse *sparse;
+    struct workers *workers;
+    // Set when looking for cycles. The scalar engine keeps the hash of the
+    // table in hash.
+    struct cycle *cycle;
+    uint64_t hash;
+    // The cycle found, period is 0 if none.
+    long period, cycle_start;
     int rows, columns;
+    struct rule rule;
+    // The edges wrap around.
+    bool torus;
+    // The table of the scalar engine has a border of ghost objects.
+    bool padded;
+    // Generations to run, 0 runs until the table is stable.
+    int generations;
+    // Generations since the start, counting those before a resume.
+    long generation;
+    // Seed of the random table, 0 if it was read from a file.
+    uint64_t seed;
+    // Set when writing checkpoints every checkpoint_every generations.
+    struct snapshot_writer *checkpoints;
+    long checkpoint_every;
+    // Set when recording every generation, or when playing a recording back
+    // instead of stepping.
+    struct recorder *recorder;
+    struct replay *replay;
+    // Set when the bitwise engine steps the table in slabs, each in a
+    // process of its own. The bitgrid is then a copy of the slabs after
+    // every step.
+    struct slabs *slabs;
+    // Set when verifying the engine: the table stepped by the scalar engine
+    // in lockstep with it, and the first generation in which they differ,
+    // 0 if none has yet, with the first object that does.
+    struct gol *reference;
+    long diverged;
+    int diverged_y, diverged_x;
+    // Set when the engine failed to step.
+    bool failed;
+    // Set when timing the phases of the run. The stats are printed at exit
+    // with stats_at_exit, and every stats_every generations into stats_json
+    // if it's set.
+    struct stats *stats;
+    bool stats_at_exit;
+    FILE *stats_json;
+    long stats_every;
+    // Draw only the objects that change on a plain terminal.
+    bool display, delta;
+    // Generations per second on the screen, 0 as fast as possible.
+    long speed;
     wint_t alive_character, not_alive_character;
     #ifdef HAVE_NCURSES
-        cchar_t ncurses_alive_character, ncurses_not_alive_character;
+        cchar_t ncurses_alive_character, ncurses_not_alive_character,
+                ncurses_blank_character;
     #endif
 };
 
-typedef void (*callback)(struct gol*, void*, int, int);
+/* A rectangle of the table. */
+struct gol_box {
+    long y, x, rows, columns;
+};
 
 struct gol*
 gol_init(const struct options_opts *opts);
 
+/* Allocates an aligned, uninitialized table of objects. */
+bool*
+gol_allocate_table(size_t objects);
+
 void
 gol_free(struct gol *g);
 
-void
+/* Returns false on error, if the engine failed to step or diverged from the
+ * reference. */
+bool
 gol_run(struct gol *g);
 
+/* Runs opts->soups random tables until they repeat, each on one thread, and
+ * prints a line for each. Returns false on error. */
+bool
+gol_search(const struct options_opts *opts);
+
+long
+gol_population(const struct gol *g);
+
+bool
+gol_is_alive(const struct gol *g, int y, int x);
+
+/* Whether the table has edges. Hashlife and the sparse engine have none,
+ * and objects can be looked at anywhere. */
+bool
+gol_is_bounded(const struct gol *g);
+
+/* Counts the alive objects in a rectangle, which may reach outside the
+ * table. */
+long
+gol_count(const struct gol *g, long y, long x, long rows, long columns);
+
+/* Objects of a row of the table of the scalar engine. */
+const bool*
+gol_row(const struct gol *g, int y);
+
+/* The objects of a row in words of 64, object x in bit x % 64 of word
+ * x / 64, packed into words unless the engine keeps them so. Only the
+ * bitwise and scalar engines are supported. */
+const uint64_t*
+gol_row_words(const struct gol *g, int y, uint64_t *words);
+
+/* Stores the objects of a row that flipped in the last generation, as the
+ * XOR of the words before and after, into flips. Returns false, with flips
+ * all zero, if none of them can have. Only right after stepping a single
+ * generation with the bitwise or scalar engine. */
+bool
+gol_row_flips(const struct gol *g, int y, uint64_t *flips);
+
+/* Stores the objects of row y from column x on into a span of columns
+ * objects, object i in bit i % 64 of words[i / 64], which has room for
+ * (columns + 63) / 64 words. Objects outside a bounded table are dead. Every
+ * engine is supported, a row at a time. */
 void
-gol_foreach_object(struct gol *g, callback cb, void *data);
+gol_span(const struct gol *g, long y, long x, long columns, uint64_t *words);
+
+/* Stores the smallest rectangle holding every alive object. Returns false
+ * if nothing is alive. */
+bool
+gol_bounding_box(const struct gol *g, struct gol_box *box);
 
 void
 gol_sleep(long wait);
@@ -0,0 +1,665 @@
+#include "hashlife.h"
+#include "life.h"
+#include "cycle.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+// Leaves are 8x8 cells, bit 8 * y + x of a 64-bit word.
+#define LEAF_LEVEL 3
+#define LEAF_SIZE 8
+// The root is kept at least 32x32, so it has grandchildren above the leaves.
+#define MIN_ROOT_LEVEL 5
+#define MAX_LEVEL 60
+// The most generations advanced at once are 2^MAX_STEP.
+#define MAX_STEP (MAX_LEVEL - 4)
+#define INITIAL_BUCKETS 4096
+// Room for the nodes kept by every level of successor() at once.
+#define STACK_CAPACITY ((MAX_LEVEL + 2) * 32)
+#define NO_RESULT -1
+// Part of the nodes a collection has to free for stepping to go on, so that
+// a universe too big for the limit doesn't collect over and over.
+#define MIN_FREED 16
+
+struct node {
+    // NULL for leaves.
+    struct node *nw, *ne, *sw, *se;
+    // Center of the node 2^result_step generations later.
+    struct node *result;
+    // Next node in the same hash bucket.
+    struct node *next;
+    // Cells of a leaf. Other nodes keep a hash of their cells in it, which
+    // doesn't depend on where the nodes are in memory.
+    uint64_t bits;
+    uint64_t population;
+    int8_t level, result_step;
+    bool marked;
+};
+
+struct hashlife {
+    struct node **buckets;
+    size_t bucket_count, nodes, max_nodes;
+    struct node *root;
+    // Nodes used by a computation in progress, kept by the garbage collector.
+    struct node **stack;
+    size_t stack_size;
+    struct node *empty[MAX_LEVEL + 1];
+    struct rule rule;
+};
+
+static inline void
+push(struct hashlife *h, struct node *n) {
+    h->stack[h->stack_size++] = n;
+}
+
+static inline size_t
+hash_leaf(uint64_t bits) {
+    bits *= UINT64_C(0x9E3779B97F4A7C15);
+    return bits ^ (bits >> 29);
+}
+
+static inline size_t
+hash_children(const struct node *nw, const struct node *ne,
+              const struct node *sw, const struct node *se) {
+    uint64_t hash = (uintptr_t) nw;
+    hash = hash * UINT64_C(0x9E3779B97F4A7C15) + (uintptr_t) ne;
+    hash = hash * UINT64_C(0x9E3779B97F4A7C15) + (uintptr_t) sw;
+    hash = hash * UINT64_C(0x9E3779B97F4A7C15) + (uintptr_t) se;
+    return hash ^ (hash >> 29);
+}
+
+static inline size_t
+hash_node(const struct node *n) {
+    return n->level == LEAF_LEVEL ? hash_leaf(n->bits) :
+        hash_children(n->nw, n->ne, n->sw, n->se);
+}
+
+static void
+mark(struct node *n) {
+    if (!n || n->marked)
+        return;
+    n->marked = true;
+    if (n->level > LEAF_LEVEL) {
+        mark(n->nw);
+        mark(n->ne);
+        mark(n->sw);
+        mark(n->se);
+    }
+}
+
+/* Frees the nodes not reachable from the root, the stack or the empty nodes.
+ * Results pointing to freed nodes are forgotten first. */
+static void
+collect(struct hashlife *h) {
+    mark(h->root);
+    for (size_t i = 0; i < h->stack_size; i++)
+        mark(h->stack[i]);
+    for (int level = 0; level <= MAX_LEVEL; level++)
+        mark(h->empty[level]);
+
+    for (size_t i = 0; i < h->bucket_count; i++) {
+        for (struct node *n = h->buckets[i]; n; n = n->next) {
+            if (n->marked && n->result && !n->result->marked) {
+                n->result = NULL;
+                n->result_step = NO_RESULT;
+            }
+        }
+    }
+    for (size_t i = 0; i < h->bucket_count; i++) {
+        struct node **link = &h->buckets[i];
+        while (*link) {
+            struct node *n = *link;
+            if (n->marked) {
+                n->marked = false;
+                link = &n->next;
+            }
+            else {
+                *link = n->next;
+                free(n);
+                h->nodes--;
+            }
+        }
+    }
+}
+
+static void
+grow_buckets(struct hashlife *h) {
+    size_t count = h->bucket_count * 2;
+    struct node **buckets = calloc(count, sizeof(*buckets));
+    if (!buckets)
+        return;
+    for (size_t i = 0; i < h->bucket_count; i++) {
+        struct node *n = h->buckets[i];
+        while (n) {
+            struct node *next = n->next;
+            size_t j = hash_node(n) & (count - 1);
+            n->next = buckets[j];
+            buckets[j] = n;
+            n = next;
+        }
+    }
+    free(h->buckets);
+    h->buckets = buckets;
+    h->bucket_count = count;
+}
+
+static struct node*
+new_node(struct hashlife *h) {
+    if (h->nodes >= h->max_nodes) {
+        collect(h);
+        if (h->nodes > h->max_nodes - h->max_nodes / MIN_FREED)
+            return NULL;
+    }
+    if (h->nodes >= h->bucket_count)
+        grow_buckets(h);
+
+    struct node *n = malloc(sizeof(*n));
+    if (!n)
+        return NULL;
+    memset(n, 0, sizeof(*n));
+    n->result_step = NO_RESULT;
+    h->nodes++;
+    return n;
+}
+
+static void
+insert(struct hashlife *h, struct node *n) {
+    size_t i = hash_node(n) & (h->bucket_count - 1);
+    n->next = h->buckets[i];
+    h->buckets[i] = n;
+}
+
+static struct node*
+leaf(struct hashlife *h, uint64_t bits) {
+    for (struct node *n = h->buckets[hash_leaf(bits) & (h->bucket_count - 1)];
+            n; n = n->next) {
+        if (n->level == LEAF_LEVEL && n->bits == bits)
+            return n;
+    }
+    struct node *n = new_node(h);
+    if (!n)
+        return NULL;
+    n->level = LEAF_LEVEL;
+    n->bits = bits;
+    n->population = __builtin_popcountll(bits);
+    insert(h, n);
+    return n;
+}
+
+static struct node*
+join(struct hashlife *h, struct node *nw, struct node *ne, struct node *sw,
+     struct node *se) {
+    size_t i = hash_children(nw, ne, sw, se) & (h->bucket_count - 1);
+    for (struct node *n = h->buckets[i]; n; n = n->next) {
+        if (n->nw == nw && n->ne == ne && n->sw == sw && n->se == se)
+            return n;
+    }
+
+    // Collecting garbage mustn't free the children.
+    size_t top = h->stack_size;
+    push(h, nw);
+    push(h, ne);
+    push(h, sw);
+    push(h, se);
+    struct node *n = new_node(h);
+    h->stack_size = top;
+    if (!n)
+        return NULL;
+
+    n->nw = nw;
+    n->ne = ne;
+    n->sw = sw;
+    n->se = se;
+    n->level = nw->level + 1;
+    n->bits = cycle_mix(cycle_mix(cycle_mix(cycle_mix(n->level ^ nw->bits) ^
+        ne->bits) ^ sw->bits) ^ se->bits);
+    n->population = nw->population + ne->population + sw->population +
+        se->population;
+    insert(h, n);
+    return n;
+}
+
+static struct node*
+empty(struct hashlife *h, int level) {
+    if (!h->empty[level]) {
+        if (level == LEAF_LEVEL)
+            h->empty[level] = leaf(h, 0);
+        else {
+            struct node *e = empty(h, level - 1);
+            h->empty[level] = e ? join(h, e, e, e, e) : NULL;
+        }
+    }
+    return h->empty[level];
+}
+
+static inline uint64_t
+leaf_row(const struct node *n, int y) {
+    return (n->bits >> (LEAF_SIZE * y)) & 0xFF;
+}
+
+/* Returns the center of a 16x16 node after generations, at most four. The
+ * cells near the edges are computed wrong, but the error moves in only one
+ * cell per generation. */
+static struct node*
+level4_result(struct hashlife *h, struct node *n, int generations) {
+    uint64_t rows[2 * LEAF_SIZE], next[2 * LEAF_SIZE];
+    for (int y = 0; y < LEAF_SIZE; y++) {
+        rows[y] = leaf_row(n->nw, y) | leaf_row(n->ne, y) << LEAF_SIZE;
+        rows[y + LEAF_SIZE] =
+            leaf_row(n->sw, y) | leaf_row(n->se, y) << LEAF_SIZE;
+    }
+    for (int i = 0; i < generations; i++) {
+        next[0] = next[2 * LEAF_SIZE - 1] = 0;
+        for (int y = 1; y < 2 * LEAF_SIZE - 1; y++) {
+            const uint64_t u = rows[y - 1], c = rows[y], d = rows[y + 1];
+            next[y] = life_rule_word(h->rule.birth, h->rule.survival,
+                u << 1, u, u >> 1, c << 1, c, c >> 1, d << 1, d, d >> 1) &
+                0xFFFF;
+        }
+        memcpy(rows, next, sizeof(rows));
+    }
+
+    uint64_t bits = 0;
+    for (int y = 0; y < LEAF_SIZE; y++) {
+        bits |= ((rows[y + LEAF_SIZE / 2] >> (LEAF_SIZE / 2)) & 0xFF) <<
+            (LEAF_SIZE * y);
+    }
+    return leaf(h, bits);
+}
+
+static struct node*
+center(struct hashlife *h, struct node *n) {
+    if (n->level == LEAF_LEVEL + 1)
+        return level4_result(h, n, 0);
+    return join(h, n->nw->se, n->ne->sw, n->sw->ne, n->se->nw);
+}
+
+static struct node*
+successor(struct hashlife *h, struct node *n, int step);
+
+/* Advances the center of a node above level 4 as successor() does. The
+ * nodes made on the way are kept on the stack, which the caller resets. */
+static struct node*
+combine(struct hashlife *h, struct node *n, int step) {
+    const bool full_speed = step == n->level - 2;
+    struct node *nine[9] = {
+        n->nw, NULL, n->ne,
+        NULL, NULL, NULL,
+        n->sw, NULL, n->se
+    };
+    // The nodes between the children, made of their quarters.
+    struct node *const between[5][4] = {
+        { n->nw->ne, n->ne->nw, n->nw->se, n->ne->sw },
+        { n->nw->sw, n->nw->se, n->sw->nw, n->sw->ne },
+        { n->nw->se, n->ne->sw, n->sw->ne, n->se->nw },
+        { n->ne->sw, n->ne->se, n->se->nw, n->se->ne },
+        { n->sw->ne, n->se->nw, n->sw->se, n->se->sw }
+    };
+    const int slots[5] = { 1, 3, 4, 5, 7 };
+    for (int i = 0; i < 5; i++) {
+        struct node *const *c = between[i];
+        if (!(nine[slots[i]] = join(h, c[0], c[1], c[2], c[3])))
+            return NULL;
+        push(h, nine[slots[i]]);
+    }
+
+    struct node *r[9];
+    for (int i = 0; i < 9; i++) {
+        r[i] = full_speed ? successor(h, nine[i], step - 1) :
+                            center(h, nine[i]);
+        if (!r[i])
+            return NULL;
+        push(h, r[i]);
+    }
+
+    const int second_step = full_speed ? step - 1 : step;
+    struct node *quarters[4];
+    const int corners[4] = { 0, 1, 3, 4 };
+    for (int i = 0; i < 4; i++) {
+        const int c = corners[i];
+        struct node *q = join(h, r[c], r[c + 1], r[c + 3], r[c + 4]);
+        if (!q)
+            return NULL;
+        push(h, q);
+        if (!(quarters[i] = successor(h, q, second_step)))
+            return NULL;
+        push(h, quarters[i]);
+    }
+    return join(h, quarters[0], quarters[1], quarters[2], quarters[3]);
+}
+
+/* Returns the center of a node 2^step generations later, where step is at
+ * most the level of the node minus two. The node is split into nine
+ * overlapping nodes a level lower whose centers are advanced, then into four
+ * again, so that in total the time advances by 2^step. Returns NULL when out
+ * of memory, like every function making nodes. */
+static struct node*
+successor(struct hashlife *h, struct node *n, int step) {
+    if (n->result && n->result_step == step)
+        return n->result;
+
+    const size_t top = h->stack_size;
+    push(h, n);
+    struct node *result;
+    if (n->population == 0)
+        result = empty(h, n->level - 1);
+    else if (n->level == LEAF_LEVEL + 1)
+        result = level4_result(h, n, 1 << step);
+    else
+        result = combine(h, n, step);
+    h->stack_size = top;
+
+    if (result) {
+        n->result = result;
+        n->result_step = step;
+    }
+    return result;
+}
+
+/* Returns a node a level higher with n in its center. */
+static struct node*
+expand(struct hashlife *h, struct node *n) {
+    struct node *e = empty(h, n->level - 1);
+    if (!e)
+        return NULL;
+    struct node *const corners[4][4] = {
+        { e, e, e, n->nw }, { e, e, n->ne, e },
+        { e, n->sw, e, e }, { n->se, e, e, e }
+    };
+    const size_t top = h->stack_size;
+    push(h, n);
+    struct node *quarters[4], *expanded = NULL;
+    int i = 0;
+    for (; i < 4; i++) {
+        struct node *const *c = corners[i];
+        if (!(quarters[i] = join(h, c[0], c[1], c[2], c[3])))
+            break;
+        push(h, quarters[i]);
+    }
+    if (i == 4)
+        expanded = join(h, quarters[0], quarters[1], quarters[2], quarters[3]);
+    h->stack_size = top;
+    return expanded;
+}
+
+/* Whether all the cells of n are in its center. */
+static bool
+is_centered(const struct node *n) {
+    return n->population == n->nw->se->population + n->ne->sw->population +
+        n->sw->ne->population + n->se->nw->population;
+}
+
+/* Makes the root as small as possible, so that the same cells always have the
+ * same root. */
+static bool
+shrink(struct hashlife *h) {
+    while (h->root->level > MIN_ROOT_LEVEL && is_centered(h->root)) {
+        struct node *root = center(h, h->root);
+        if (!root)
+            return false;
+        h->root = root;
+    }
+    return true;
+}
+
+static struct node*
+build(struct hashlife *h, const bool *table, int rows, int columns,
+      int level, long y0, long x0) {
+    if (y0 >= rows || x0 >= columns)
+        return empty(h, level);
+    if (level == LEAF_LEVEL) {
+        uint64_t bits = 0;
+        for (int y = 0; y < LEAF_SIZE && y0 + y < rows; y++) {
+            for (int x = 0; x < LEAF_SIZE && x0 + x < columns; x++) {
+                if (table[(y0 + y) * columns + x0 + x])
+                    bits |= UINT64_C(1) << (LEAF_SIZE * y + x);
+            }
+        }
+        return leaf(h, bits);
+    }
+
+    const size_t top = h->stack_size;
+    const long half = 1L << (level - 1);
+    struct node *quarters[4], *n = NULL;
+    int i = 0;
+    for (; i < 4; i++) {
+        quarters[i] = build(h, table, rows, columns, level - 1,
+            y0 + (i / 2) * half, x0 + (i % 2) * half);
+        if (!quarters[i])
+            break;
+        push(h, quarters[i]);
+    }
+    if (i == 4)
+        n = join(h, quarters[0], quarters[1], quarters[2], quarters[3]);
+    h->stack_size = top;
+    return n;
+}
+
+struct hashlife*
+hashlife_init(const bool *table, int rows, int columns, struct rule rule,
+              size_t max_nodes) {
+    struct hashlife *h = malloc(sizeof(*h));
+    if (!h)
+        return NULL;
+    memset(h, 0, sizeof(*h));
+    h->rule = rule;
+    h->max_nodes = max_nodes;
+    h->bucket_count = INITIAL_BUCKETS;
+    h->buckets = calloc(h->bucket_count, sizeof(*h->buckets));
+    h->stack = malloc(sizeof(*h->stack) * STACK_CAPACITY);
+    if (!h->buckets || !h->stack) {
+        hashlife_free(h);
+        return NULL;
+    }
+
+    int level = LEAF_LEVEL;
+    while ((1L << level) < rows || (1L << level) < columns)
+        level++;
+    // The table is the south east quarter of the root, so it starts at (0, 0).
+    struct node *table_node = build(h, table, rows, columns, level, 0, 0);
+    struct node *e = table_node ? empty(h, level) : NULL;
+    if (e) {
+        push(h, table_node);
+        h->root = join(h, e, e, e, table_node);
+        h->stack_size = 0;
+    }
+    while (h->root && h->root->level < MIN_ROOT_LEVEL)
+        h->root = expand(h, h->root);
+    if (!h->root || !shrink(h)) {
+        hashlife_free(h);
+        return NULL;
+    }
+    return h;
+}
+
+void
+hashlife_free(struct hashlife *h) {
+    if (!h)
+        return;
+    if (h->buckets) {
+        for (size_t i = 0; i < h->bucket_count; i++) {
+            struct node *n = h->buckets[i];
+            while (n) {
+                struct node *next = n->next;
+                free(n);
+                n = next;
+            }
+        }
+    }
+    free(h->buckets);
+    free(h->stack);
+    free(h);
+}
+
+/* Advances the universe 2^step generations. The root is expanded until the
+ * cells can't reach the edge of the center that successor() returns. Returns
+ * false when out of memory, with the root holding the same cells. */
+static bool
+advance(struct hashlife *h, int step) {
+    struct node *root;
+    while (h->root->level < step + 3 || !is_centered(h->root)) {
+        if (!(root = expand(h, h->root)))
+            return false;
+        h->root = root;
+    }
+    if (!(root = expand(h, h->root)))
+        return false;
+    h->root = root;
+    if (!(root = successor(h, h->root, step)))
+        return false;
+    h->root = root;
+    return shrink(h);
+}
+
+bool
+hashlife_step(struct hashlife *h, uint64_t generations, bool *changed) {
+    struct node *before = h->root;
+    push(h, before);
+    bool ok = true;
+    for (int step = 63; ok && step >= 0; step--) {
+        if (!(generations & (UINT64_C(1) << step)))
+            continue;
+        // Jumps further than the levels allow are made in several.
+        const int jump = step < MAX_STEP ? step : MAX_STEP;
+        for (uint64_t i = 0; ok && i < UINT64_C(1) << (step - jump); i++)
+            ok = advance(h, jump);
+    }
+    h->stack_size--;
+    // Both roots have been shrunk, so they are the same node if and only if
+    // the cells are the same.
+    *changed = before != h->root;
+    return ok;
+}
+
+bool
+hashlife_get(const struct hashlife *h, long y, long x) {
+    const struct node *n = h->root;
+    long half = 1L << (n->level - 1);
+    if (y < -half || y >= half || x < -half || x >= half)
+        return false;
+    y += half;
+    x += half;
+    while (n->level > LEAF_LEVEL) {
+        if (n->population == 0)
+            return false;
+        half = 1L << (n->level - 1);
+        if (y < half)
+            n = x < half ? n->nw : n->ne;
+        else
+            n = x < half ? n->sw : n->se;
+        y %= half;
+        x %= half;
+    }
+    return (n->bits >> (LEAF_SIZE * y + x)) & 1;
+}
+
+uint64_t
+hashlife_population(const struct hashlife *h) {
+    return h->root->population;
+}
+
+/* Counts the cells of n, whose top left corner is at (y, x), that are in the
+ * rectangle from (top, left) to (bottom, right). */
+static uint64_t
+count(const struct node *n, long y, long x, long top, long left, long bottom,
+      long right) {
+    const long size = 1L << n->level;
+    if (n->population == 0 || y >= bottom || x >= right || y + size <= top ||
+            x + size <= left)
+        return 0;
+    if (top <= y && left <= x && y + size <= bottom && x + size <= right)
+        return n->population;
+    if (n->level == LEAF_LEVEL) {
+        uint64_t bits = 0;
+        for (long cy = 0; cy < LEAF_SIZE; cy++) {
+            for (long cx = 0; cx < LEAF_SIZE; cx++) {
+                if (y + cy >= top && y + cy < bottom && x + cx >= left &&
+                        x + cx < right)
+                    bits |= UINT64_C(1) << (LEAF_SIZE * cy + cx);
+            }
+        }
+        return __builtin_popcountll(n->bits & bits);
+    }
+    const long half = size / 2;
+    return count(n->nw, y, x, top, left, bottom, right) +
+        count(n->ne, y, x + half, top, left, bottom, right) +
+        count(n->sw, y + half, x, top, left, bottom, right) +
+        count(n->se, y + half, x + half, top, left, bottom, right);
+}
+
+uint64_t
+hashlife_count(const struct hashlife *h, long y, long x, long rows,
+               long columns) {
+    const long half = 1L << (h->root->level - 1);
+    return count(h->root, -half, -half, y, x, y + rows, x + columns);
+}
+
+/* ORs the cells of n, whose top left corner is at (ny, nx), that are in the
+ * span of row y from column x into words. */
+static void
+span(const struct node *n, long ny, long nx, long y, long x, long columns,
+     uint64_t *words) {
+    const long size = 1L << n->level;
+    if (n->population == 0 || y < ny || y >= ny + size || nx >= x + columns ||
+            nx + size <= x)
+        return;
+    if (n->level == LEAF_LEVEL) {
+        life_put_span(words, columns, nx - x, leaf_row(n, y - ny));
+        return;
+    }
+    const long half = size / 2;
+    if (y < ny + half) {
+        span(n->nw, ny, nx, y, x, columns, words);
+        span(n->ne, ny, nx + half, y, x, columns, words);
+    }
+    else {
+        span(n->sw, ny + half, nx, y, x, columns, words);
+        span(n->se, ny + half, nx + half, y, x, columns, words);
+    }
+}
+
+void
+hashlife_span(const struct hashlife *h, long y, long x, long columns,
+              uint64_t *words) {
+    memset(words, 0, sizeof(*words) * ((columns + 63) / 64));
+    const long half = 1L << (h->root->level - 1);
+    span(h->root, -half, -half, y, x, columns, words);
+}
+
+/* Grows the rectangle to hold the cells of n, whose top left corner is at
+ * (y, x). Nodes inside the rectangle already can't grow it. */
+static void
+bounds(const struct node *n, long y, long x, long *top, long *left,
+       long *bottom, long *right) {
+    const long size = 1L << n->level;
+    if (n->population == 0 || (*top <= y && *left <= x &&
+            y + size <= *bottom && x + size <= *right))
+        return;
+    if (n->level == LEAF_LEVEL) {
+        for (int cy = 0; cy < LEAF_SIZE; cy++) {
+            const uint64_t row = leaf_row(n, cy);
+            if (row)
+                life_bound_word(row, y + cy, x, top, left, bottom, right);
+        }
+        return;
+    }
+    const long half = size / 2;
+    bounds(n->nw, y, x, top, left, bottom, right);
+    bounds(n->ne, y, x + half, top, left, bottom, right);
+    bounds(n->sw, y + half, x, top, left, bottom, right);
+    bounds(n->se, y + half, x + half, top, left, bottom, right);
+}
+
+bool
+hashlife_bounds(const struct hashlife *h, long *top, long *left,
+                long *bottom, long *right) {
+    *top = *left = LONG_MAX;
+    *bottom = *right = LONG_MIN;
+    const long half = 1L << (h->root->level - 1);
+    bounds(h->root, -half, -half, top, left, bottom, right);
+    return h->root->population != 0;
+}
+
+uint64_t
+hashlife_hash(const struct hashlife *h) {
+    return h->root->bits;
+}
@@ -0,0 +1,62 @@
+#ifndef HASHLIFE_H
+    #define HASHLIFE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rule.h"
+
+/* Hashlife: the universe is a quadtree of canonical nodes, each of which
+ * remembers the center of itself some generations later. The universe is
+ * unbounded; the starting table is placed with its top left corner at
+ * (0, 0). */
+struct hashlife;
+
+/* At most max_nodes nodes are kept. When there are more, nodes not reachable
+ * from the universe are freed and remembered results pointing to them are
+ * forgotten. If that doesn't free a sixteenth of them, the universe doesn't
+ * fit and stepping fails. The rule must not have B0, or nothing would stay
+ * empty. Returns NULL when out of memory. */
+struct hashlife*
+hashlife_init(const bool *table, int rows, int columns, struct rule rule,
+              size_t max_nodes);
+
+void
+hashlife_free(struct hashlife *h);
+
+/* Jumps generations forward and stores whether the universe changed.
+ * Returns false when out of memory, with the universe in some generation
+ * on the way. */
+bool
+hashlife_step(struct hashlife *h, uint64_t generations, bool *changed);
+
+bool
+hashlife_get(const struct hashlife *h, long y, long x);
+
+uint64_t
+hashlife_population(const struct hashlife *h);
+
+/* Counts the alive cells in a rectangle from the populations of the nodes
+ * in it. */
+uint64_t
+hashlife_count(const struct hashlife *h, long y, long x, long rows,
+               long columns);
+
+/* Stores the cells of row y from column x on into a span of columns cells,
+ * cell i in bit i % 64 of words[i / 64]. Only the nodes on the row are
+ * looked at. */
+void
+hashlife_span(const struct hashlife *h, long y, long x, long columns,
+              uint64_t *words);
+
+/* Stores the smallest rectangle holding every alive cell, from (top, left)
+ * to before (bottom, right), skipping the nodes inside it already. Returns
+ * false if nothing is alive. */
+bool
+hashlife_bounds(const struct hashlife *h, long *top, long *left,
+                long *bottom, long *right);
+
+/* Hash of the cells, the same whenever the cells are. */
+uint64_t
+hashlife_hash(const struct hashlife *h);
+
+#endif // HASHLIFE_H
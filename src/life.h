@@ -0,0 +1,121 @@
+#ifndef LIFE_H
+    #define LIFE_H
+#include <stdint.h>
+#define LIFE_INLINE static inline __attribute__((always_inline))
+
+/* Computes the next state of 64 cells. ul, u and ur are the upper left, upper
+ * and upper right neighbors of each bit, and so on. The neighbors are summed
+ * with bit-sliced adders: a full adder for the row above, another for the
+ * row below and a half adder for the left and right neighbors. */
+static inline uint64_t
+life_word(uint64_t ul, uint64_t u, uint64_t ur,
+          uint64_t l, uint64_t c, uint64_t r,
+          uint64_t dl, uint64_t d, uint64_t dr) {
+    uint64_t u_ones = ul ^ u ^ ur, u_twos = (ul & u) | (ur & (ul ^ u));
+    uint64_t d_ones = dl ^ d ^ dr, d_twos = (dl & d) | (dr & (dl ^ d));
+    uint64_t m_ones = l ^ r, m_twos = l & r;
+
+    uint64_t ones = u_ones ^ d_ones ^ m_ones;
+    uint64_t carry = (u_ones & d_ones) | (m_ones & (u_ones ^ d_ones));
+    // Exactly one of the twos is set: the sum of neighbors is 2 or 3.
+    uint64_t x = u_twos ^ d_twos, y = m_twos ^ carry;
+    uint64_t one_two = (x ^ y) & ~((u_twos & d_twos) | (m_twos & carry));
+
+    return one_two & (ones | c);
+}
+
+/* Sums the neighbors into bit-sliced counts: bit i of ones, twos and fours
+ * is the count of cell i in binary, and eights is set only when all eight
+ * neighbors are alive, and then the others aren't. */
+LIFE_INLINE void
+life_count(uint64_t ul, uint64_t u, uint64_t ur,
+           uint64_t l, uint64_t r,
+           uint64_t dl, uint64_t d, uint64_t dr,
+           uint64_t *ones, uint64_t *twos, uint64_t *fours,
+           uint64_t *eights) {
+    uint64_t u_ones = ul ^ u ^ ur, u_twos = (ul & u) | (ur & (ul ^ u));
+    uint64_t d_ones = dl ^ d ^ dr, d_twos = (dl & d) | (dr & (dl ^ d));
+    uint64_t m_ones = l ^ r, m_twos = l & r;
+
+    *ones = u_ones ^ d_ones ^ m_ones;
+    uint64_t carry = (u_ones & d_ones) | (m_ones & (u_ones ^ d_ones));
+    // Four words of twos: add three of them and the carry of those.
+    uint64_t t_ones = u_twos ^ d_twos ^ m_twos;
+    uint64_t t_twos = (u_twos & d_twos) | (m_twos & (u_twos ^ d_twos));
+    *twos = t_ones ^ carry;
+    uint64_t four_carry = t_ones & carry;
+    *fours = t_twos ^ four_carry;
+    *eights = t_twos & four_carry;
+}
+
+/* Selects b where s is set and a elsewhere. */
+LIFE_INLINE uint64_t
+life_select(uint64_t s, uint64_t a, uint64_t b) {
+    return a ^ ((a ^ b) & s);
+}
+
+/* Looks up the entry of a table of nine bits for each count, with a tree of
+ * selects on the bits of the count. When the table is a constant, the
+ * compiler folds the tree into a few operations. */
+LIFE_INLINE uint64_t
+life_lookup(uint16_t table, uint64_t ones, uint64_t twos, uint64_t fours,
+            uint64_t eights) {
+    #define ENTRY(n) (-(uint64_t) ((table >> (n)) & 1))
+    uint64_t low = life_select(twos, life_select(ones, ENTRY(0), ENTRY(1)),
+        life_select(ones, ENTRY(2), ENTRY(3)));
+    uint64_t high = life_select(twos, life_select(ones, ENTRY(4), ENTRY(5)),
+        life_select(ones, ENTRY(6), ENTRY(7)));
+    return life_select(eights, life_select(fours, low, high), ENTRY(8));
+    #undef ENTRY
+}
+
+/* Same as life_word(), but for any rule. Kernels that call it with a
+ * constant rule are as specialized as life_word(). */
+LIFE_INLINE uint64_t
+life_rule_word(uint16_t birth, uint16_t survival,
+               uint64_t ul, uint64_t u, uint64_t ur,
+               uint64_t l, uint64_t c, uint64_t r,
+               uint64_t dl, uint64_t d, uint64_t dr) {
+    uint64_t ones, twos, fours, eights;
+    life_count(ul, u, ur, l, r, dl, d, dr, &ones, &twos, &fours, &eights);
+    return life_select(c, life_lookup(birth, ones, twos, fours, eights),
+        life_lookup(survival, ones, twos, fours, eights));
+}
+
+/* ORs the 64 cells of bits into a span of columns cells in words, cell i of
+ * bits at column at + i of the span. Cells outside the span are left out. */
+LIFE_INLINE void
+life_put_span(uint64_t *words, long columns, long at, uint64_t bits) {
+    if (at <= -64 || at >= columns)
+        return;
+    if (at < 0) {
+        bits >>= -at;
+        at = 0;
+    }
+    if (columns - at < 64)
+        bits &= (UINT64_C(1) << (columns - at)) - 1;
+    if (!bits)
+        return;
+    words[at / 64] |= bits << (at % 64);
+    if (at % 64 && at / 64 + 1 < (columns + 63) / 64)
+        words[at / 64 + 1] |= bits >> (64 - at % 64);
+}
+
+/* Grows the rectangle from (top, left) to (bottom, right) to hold the cells
+ * of bits, which mustn't be 0, cell i at row y and column x + i. */
+LIFE_INLINE void
+life_bound_word(uint64_t bits, long y, long x, long *top, long *left,
+                long *bottom, long *right) {
+    const long first = x + __builtin_ctzll(bits);
+    const long last = x + 64 - __builtin_clzll(bits);
+    if (y < *top)
+        *top = y;
+    if (y >= *bottom)
+        *bottom = y + 1;
+    if (first < *left)
+        *left = first;
+    if (last > *right)
+        *right = last;
+}
+
+#endif // LIFE_H
@@ -15,6 +15,9 @@ main(int argc, char **argv) {
     else if (retval == OPTIONS_HELP)
         exit(EXIT_SUCCESS);
 
+    if (opts.soups)
+        exit(gol_search(&opts) ? EXIT_SUCCESS : EXIT_FAILURE);
+
     int exit_value = EXIT_SUCCESS;
 
     struct gol *g = gol_init(&opts);
@@ -22,7 +25,8 @@ main(int argc, char **argv) {
         exit_value = EXIT_FAILURE;
         goto end;
     }
-    gol_run(g);
+    if (!gol_run(g))
+        exit_value = EXIT_FAILURE;
 
     end:
         gol_free(g);
@@ -2,72 +2,132 @@
 #include "gol.h"
 #include <curses.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #define KEY_QUIT 'q'
 #define KEY_STOP 's'
 #define KEY_SPEED_UP '+'
 #define KEY_SPEED_DOWN '-'
-#define WAIT_STEP 50000000L
-#define WAIT_MAX 999999999L
+#define KEY_ZOOM_IN 'i'
+#define KEY_ZOOM_OUT 'o'
+#define KEY_MODE 'm'
+// The cells of a character, the scale squared, fit in a long.
+#define MAX_ZOOM 30
+#define BRAILLE 0x2800
+#define DENSITY_GLYPHS " .:-=+*#%@"
 
-static void
-draw_object_cb(struct gol *g, void *data, int y, int x) {
-    const cchar_t wc = g->table[y][x].alive_this_round ?
-        g->ncurses_alive_character : g->ncurses_not_alive_character;
-    add_wch(&wc);
-    if (x == g->columns - 1)
-        move(y + 1, 0);
-}
+static struct frame_view view = { 0, 0, 0, 0, 0, false };
 
-static enum ncurses_return_value
-wait_until_stop_or_quit() {
-    nodelay(stdscr, false);
-    flushinp();
-    int key;
-    do {
-        if ((key = getch()) == KEY_QUIT)
-            return NCURSES_QUIT;
-    } while (key != KEY_STOP);
-    nodelay(stdscr, true);
+// What is on the screen, to draw only the characters that change.
+static struct frame_view shown_view;
+static uint8_t *shown = NULL;
+static size_t shown_capacity = 0;
 
-    return NCURSES_OK;
+/* Keeps the table on the screen, unless it has no edges. */
+static void
+clamp_view(const struct gol *g) {
+    if (!gol_is_bounded(g))
+        return;
+    const long rows = view.rows * frame_character_rows(&view);
+    const long columns = view.columns * frame_character_columns(&view);
+    if (view.y > g->rows - rows)
+        view.y = g->rows - rows;
+    if (view.x > g->columns - columns)
+        view.x = g->columns - columns;
+    if (view.y < 0)
+        view.y = 0;
+    if (view.x < 0)
+        view.x = 0;
 }
 
 static void
-wait_more(long *wait) {
-    if (*wait + WAIT_STEP <= WAIT_MAX)
-        *wait += WAIT_STEP;
+draw_code(const struct gol *g, const struct frame *f, int row, int column,
+          uint8_t code) {
+    if (!f->view.zoom) {
+        const cchar_t *wc = code == FRAME_ALIVE ?
+            &g->ncurses_alive_character : code == FRAME_NOT_ALIVE ?
+            &g->ncurses_not_alive_character : &g->ncurses_blank_character;
+        mvadd_wch(row, column, wc);
+        return;
+    }
+    wchar_t wc[2] = { 0, 0 };
+    wc[0] = f->view.braille ? BRAILLE | code : DENSITY_GLYPHS[code];
+    cchar_t cc;
+    setcchar(&cc, wc, 0, 0, NULL);
+    mvadd_wch(row, column, &cc);
 }
 
-static void
-wait_less(long *wait) {
-    if (*wait > 0)
-        *wait -= WAIT_STEP;
+static bool
+same_view(const struct frame_view *a, const struct frame_view *b) {
+    return a->y == b->y && a->x == b->x && a->rows == b->rows &&
+           a->columns == b->columns && a->zoom == b->zoom &&
+           a->braille == b->braille;
 }
 
+/* Whether a character already covers the whole of a bounded table. */
 static bool
-validate_rows_and_columns(const struct gol *g) {
-    if (LINES < g->rows) {
-        ncurses_end();
-        fprintf(stderr, "rows option is larger than screen\n");
-        return false;
-    }
-    if (COLS < g->columns) {
-        ncurses_end();
-        fprintf(stderr, "columns option is larger than screen\n");
-        return false;
+covers_table(const struct gol *g) {
+    return gol_is_bounded(g) && frame_character_rows(&view) >= g->rows &&
+           frame_character_columns(&view) >= g->columns;
+}
+
+/* Pans by a quarter of the screen or zooms, keeping the center in place.
+ * Returns false if the key doesn't move the view. */
+static bool
+move_view(const struct gol *g, int key) {
+    const long center_y = view.y + view.rows * frame_character_rows(&view) / 2;
+    const long center_x = view.x +
+        view.columns * frame_character_columns(&view) / 2;
+    switch (key) {
+        case KEY_UP:
+        case 'k':
+            view.y -= (view.rows / 4 + 1) * frame_character_rows(&view);
+            break;
+        case KEY_DOWN:
+        case 'j':
+            view.y += (view.rows / 4 + 1) * frame_character_rows(&view);
+            break;
+        case KEY_LEFT:
+        case 'h':
+            view.x -= (view.columns / 4 + 1) * frame_character_columns(&view);
+            break;
+        case KEY_RIGHT:
+        case 'l':
+            view.x += (view.columns / 4 + 1) * frame_character_columns(&view);
+            break;
+        case KEY_ZOOM_IN:
+        case KEY_ZOOM_OUT:
+        case KEY_MODE:
+            if (key == KEY_ZOOM_IN && view.zoom > 0)
+                view.zoom--;
+            else if (key == KEY_ZOOM_OUT && view.zoom < MAX_ZOOM &&
+                    !covers_table(g))
+                view.zoom++;
+            else if (key == KEY_MODE)
+                view.braille = !view.braille;
+            view.y = center_y - view.rows * frame_character_rows(&view) / 2;
+            view.x = center_x -
+                view.columns * frame_character_columns(&view) / 2;
+            break;
+        case KEY_RESIZE:
+            view.rows = LINES;
+            view.columns = COLS;
+            break;
+        default:
+            return false;
     }
+    clamp_view(g);
     return true;
 }
 
 bool
-ncurses_init(struct gol *g) {
+ncurses_init(struct gol *g, struct frame_view *v) {
     initscr();
-    if (!validate_rows_and_columns(g))
-        return false;
     cbreak();
+    keypad(stdscr, true);
     noecho();
     curs_set(0);
-    nodelay(stdscr, true);
+    timeout(1000 / DISPLAY_FRAMES_PER_SECOND);
     clear();
     refresh();
     
@@ -75,31 +135,62 @@ ncurses_init(struct gol *g) {
         (wchar_t*) &g->alive_character, 0, 0, 0);
     setcchar(&g->ncurses_not_alive_character,
         (wchar_t*) &g->not_alive_character, 0, 0, 0);
+    setcchar(&g->ncurses_blank_character, L" ", 0, 0, 0);
 
+    view.rows = LINES;
+    view.columns = COLS;
+    *v = view;
     return true;
 }
 
+/* Draws the whole frame the first time and when its view isn't the one on
+ * the screen. Otherwise only the characters that changed are drawn. */
 void
-ncurses_draw(struct gol *g) {
-    move(0, 0);
-    refresh();
-    gol_foreach_object(g, draw_object_cb, NULL);
+ncurses_draw(const struct gol *g, const struct frame *f) {
+    const size_t size = (size_t) f->view.rows * f->view.columns;
+    bool all = !shown || !same_view(&f->view, &shown_view);
+    if (size > shown_capacity) {
+        free(shown);
+        shown_capacity = 0;
+        if ((shown = malloc(size)))
+            shown_capacity = size;
+        all = true;
+    }
+    if (all)
+        erase();
+    for (int row = 0; row < f->view.rows; row++) {
+        for (int column = 0; column < f->view.columns; column++) {
+            const size_t i = (size_t) row * f->view.columns + column;
+            if (all || shown[i] != f->codes[i])
+                draw_code(g, f, row, column, f->codes[i]);
+        }
+    }
+    if (shown) {
+        memcpy(shown, f->codes, size);
+        shown_view = f->view;
+    }
     refresh();
 }
 
 enum ncurses_return_value
-ncurses_handle_key(long *wait) {
-    switch (getch()) {
+ncurses_handle_key(const struct gol *g, struct display *d) {
+    const int key = getch();
+    if (move_view(g, key)) {
+        display_set_view(d, &view);
+        flushinp();
+        return NCURSES_OK;
+    }
+    switch (key) {
         case KEY_QUIT:
             return NCURSES_QUIT;
         case KEY_SPEED_DOWN:
-            wait_more(wait);
+            display_slow_down(d);
             break;
         case KEY_SPEED_UP:
-            wait_less(wait);
+            display_speed_up(d);
             break;
         case KEY_STOP:
-            return wait_until_stop_or_quit();
+            display_toggle_pause(d);
             break;
     }
     flushinp();
@@ -109,5 +200,8 @@ ncurses_handle_key(long *wait) {
 
 void
 ncurses_end() {
+    free(shown);
+    shown = NULL;
+    shown_capacity = 0;
     endwin();
 }
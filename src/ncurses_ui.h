@@ -1,19 +1,24 @@
 #ifndef NCURSES_UI_H
     #define NCURSES_UI_H
+#include "display.h"
+#include "frame.h"
 #include "gol.h"
 
 enum ncurses_return_value {
     NCURSES_OK, NCURSES_ERR, NCURSES_QUIT
 };
 
+/* Sets v to the view of the whole screen. */
 bool
-ncurses_init(struct gol *g);
+ncurses_init(struct gol *g, struct frame_view *v);
 
 void
-ncurses_draw(struct gol *g);
+ncurses_draw(const struct gol *g, const struct frame *f);
 
+/* Waits a frame for a key. Handles the keys changing the rate, pausing and
+ * moving the view. */
 enum ncurses_return_value
-ncurses_handle_key(long *wait);
+ncurses_handle_key(const struct gol *g, struct display *d);
 
 void
 ncurses_end();
@@ -1,4 +1,5 @@
 #include "options.h"
+#include "bitgrid.h"
 #include <stdlib.h>
 #include <errno.h>
 #include <limits.h>
@@ -10,12 +11,21 @@
 #define DEFAULT_PROBABILTY 0.3
 #define DEFAULT_ALIVE_CHARACTER L'o'
 #define DEFAULT_NOT_ALIVE_CHARACTER L' '
+#define DEFAULT_SPEED 3
+#define DEFAULT_STATS_EVERY 1000
+#define DEFAULT_SOUP_CYCLES 100
 #define OPTION_ROWS                1
 #define OPTION_COLUMNS             2
 #define OPTION_PROBABILITY         4
 #define OPTION_ALIVE_CHARACTER     8
 #define OPTION_NOT_ALIVE_CHARACTER 16
 #define OPTION_FILE                32
+#define OPTION_RESUME              64
+#define OPTION_SPEED               128
+#define OPTION_SEED                256
+#define OPTION_REPLAY              512
+#define OPTION_TOPOLOGY            1024
+#define OPTION_SOURCES (OPTION_FILE | OPTION_RESUME | OPTION_REPLAY)
 
 static void
 read_int_arg(const char *arg, int *result, const char **error) {
@@ -39,6 +49,26 @@ read_int_arg(const char *arg, int *result, const char **error) {
     *result = l;
 }
 
+static void
+read_seed_arg(const char *arg, uint64_t *result, const char **error) {
+    char *endptr;
+    errno = 0;
+    unsigned long long ull = strtoull(arg, &endptr, 10);
+    if (*arg == '\0' || *arg == '-' || *endptr != '\0') {
+        *error = "is not a number";
+        return;
+    }
+    if ((errno == ERANGE && ull == ULLONG_MAX) || ull > UINT64_MAX) {
+        *error = "too high";
+        return;
+    }
+    if (ull == 0) {
+        *error = "too low";
+        return;
+    }
+    *result = ull;
+}
+
 static void
 read_double_arg(const char *arg, double *result, const char **error) {
     char *endptr;
@@ -59,6 +89,59 @@ read_double_arg(const char *arg, double *result, const char **error) {
     *result = d;
 }
 
+static void
+read_speed_arg(const char *arg, int *result, const char **error) {
+    if (strcmp(arg, "max") == 0)
+        *result = 0;
+    else
+        read_int_arg(arg, result, error);
+}
+
+static void
+read_rule_arg(const char *arg, struct rule *result, const char **error) {
+    if (!rule_parse(arg, result))
+        *error = "is not a rule like B3/S23";
+}
+
+static void
+read_engine_arg(const char *arg, enum options_engine *result,
+                const char **error) {
+    if (strcmp(arg, "bitwise") == 0)
+        *result = OPTIONS_ENGINE_BITWISE;
+    else if (strcmp(arg, "scalar") == 0)
+        *result = OPTIONS_ENGINE_SCALAR;
+    else if (strcmp(arg, "hashlife") == 0)
+        *result = OPTIONS_ENGINE_HASHLIFE;
+    else if (strcmp(arg, "sparse") == 0)
+        *result = OPTIONS_ENGINE_SPARSE;
+    else
+        *error = "is not bitwise, scalar, hashlife or sparse";
+}
+
+static void
+read_topology_arg(const char *arg, enum options_topology *result,
+                  const char **error) {
+    if (strcmp(arg, "bounded") == 0)
+        *result = OPTIONS_TOPOLOGY_BOUNDED;
+    else if (strcmp(arg, "torus") == 0)
+        *result = OPTIONS_TOPOLOGY_TORUS;
+    else
+        *error = "is not bounded or torus";
+}
+
+static void
+read_format_arg(const char *arg, enum options_format *result,
+                const char **error) {
+    if (strcmp(arg, "plain") == 0)
+        *result = OPTIONS_FORMAT_PLAIN;
+    else if (strcmp(arg, "rle") == 0)
+        *result = OPTIONS_FORMAT_RLE;
+    else if (strcmp(arg, "life106") == 0)
+        *result = OPTIONS_FORMAT_LIFE106;
+    else
+        *error = "is not plain, rle or life106";
+}
+
 static void
 first_wide_char_in_str(const char *s, wint_t *wc, const char **error) {
     wchar_t wa[MB_LEN_MAX];
@@ -84,22 +167,108 @@ print_help(const char *program_name) {
         "Usage: %s [OPTIONS] -r ROWS -c COLUMNS\n"
         "   -a, --alive-character       "
             "a character representing an alive object\n"
+        "   -b, --soups                 "
+            "run this many random tables from consecutive\n"
+        "                               "
+            "seeds until they repeat, one on every thread,\n"
+        "                               "
+            "print the seed, generations to settle,\n"
+        "                               "
+            "population and period of each\n"
+        "   -B, --block                 "
+            "advance this many generations at a time in\n"
+        "                               "
+            "blocks that stay in the cache, at most %d,\n"
+        "                               "
+            "bitwise engine only\n"
         "   -c, --columns\n"
+        "   -C, --cycles                "
+            "stop when the table repeats one of this many\n"
+        "                               "
+            "last generations, report the period, default\n"
+        "                               "
+            "%d with soups\n"
+        #ifndef HAVE_NCURSES
+        "   -D, --delta                 "
+            "after the first frame, draw only what changed\n"
+        #endif
+        "   -d, --no-display            "
+            "don't draw, print a throughput report at exit\n"
+        "   -e, --engine                "
+            "bitwise (default), scalar, hashlife or sparse,\n"
+        "                               "
+            "the last two have no edges and hashlife jumps\n"
+        "                               "
+            "all generations at once\n"
         "   -f, --file                  read game starting position from file\n"
+        "   -F, --format                "
+            "plain, rle or life106, default by file name\n"
+        "   -g, --generations           "
+            "run this many generations, default until stable\n"
+        "   -G, --seek                  "
+            "play back from this generation\n"
         "   -h, --help                  print this help\n"
+        "   -i, --stats                 "
+            "time every phase of the run, print the times\n"
+        "                               "
+            "and counters at exit and on SIGUSR1\n"
+        "   -j, --stats-json            "
+            "append the stats to this file as JSON lines\n"
+        "   -J, --stats-every           "
+            "generations between JSON lines, default %d\n"
+        "   -k, --checkpoint            "
+            "file of the checkpoints, default gol.snapshot\n"
+        "   -K, --checkpoint-every      "
+            "write a checkpoint every this many generations\n"
+        "   -m, --processes             "
+            "split the table into this many slabs, each\n"
+        "                               "
+            "stepped by a process of its own pinned to a\n"
+        "                               "
+            "NUMA node in turn, bitwise engine only\n"
         "   -n, --not-alive-character   "
             "a character representing an object not alive\n"
+        "   -o, --record                "
+            "record every generation into this file\n"
         "   -p, --probability           default %g\n"
+        "   -P, --replay                "
+            "play a recording back instead of stepping\n"
         "   -r, --rows\n"
+        "   -R, --resume                continue from a checkpoint\n"
+        "   -s, --speed                 "
+            "generations per second on the screen, max for\n"
+        "                               "
+            "as fast as possible, default %d\n"
+        "   -S, --seed                  "
+            "seed of the random table, default from the time\n"
+        "   -t, --threads               "
+            "number of threads stepping the game, default 1\n"
+        "   -T, --topology              "
+            "bounded (default) or torus, where the edges wrap\n"
+        "   -u, --rule                  "
+            "B3/S23 (default), B36/S23 or any other B/S rule,\n"
+        "                               "
+            "overrides the rule of a file\n"
+        "   -v, --verify                "
+            "step the scalar engine alongside, stop at the\n"
+        "                               "
+            "first generation and object where they differ,\n"
+        "                               "
+            "bitwise and scalar engines only\n"
         #ifdef HAVE_NCURSES
         "Keys:\n"
-        "   s   stop\n"
+        "   s   stop or continue\n"
         "   q   quit\n"
-        "   +   speed up\n"
-        "   -   speed down\n"
+        "   +   double the speed\n"
+        "   -   halve the speed\n"
+        "   arrows or h, j, k, l   move\n"
+        "   i   zoom in\n"
+        "   o   zoom out\n"
+        "   m   switch between density glyphs and Braille\n"
         #endif
         ,
-        program_name, DEFAULT_PROBABILTY 
+        program_name, BITGRID_MAX_BLOCK, DEFAULT_SOUP_CYCLES,
+        DEFAULT_STATS_EVERY, DEFAULT_PROBABILTY, DEFAULT_SPEED
     );
 }
 
@@ -107,12 +276,36 @@ static struct option*
 init_longopts() {
     static struct option longopts[] = {
         { "alive-character",      1, NULL, 'a' },
+        { "soups",                1, NULL, 'b' },
+        { "block",                1, NULL, 'B' },
         { "columns",              1, NULL, 'c' },
+        { "cycles",               1, NULL, 'C' },
+        { "delta",                0, NULL, 'D' },
+        { "no-display",           0, NULL, 'd' },
+        { "engine",               1, NULL, 'e' },
         { "file",                 1, NULL, 'f' },
+        { "format",               1, NULL, 'F' },
+        { "generations",          1, NULL, 'g' },
+        { "seek",                 1, NULL, 'G' },
         { "help",                 0, NULL, 'h' },
+        { "stats",                0, NULL, 'i' },
+        { "stats-json",           1, NULL, 'j' },
+        { "stats-every",          1, NULL, 'J' },
+        { "checkpoint",           1, NULL, 'k' },
+        { "checkpoint-every",     1, NULL, 'K' },
+        { "processes",            1, NULL, 'm' },
         { "not-alive-character",  1, NULL, 'n' },
+        { "record",               1, NULL, 'o' },
         { "probability",          1, NULL, 'p' },
+        { "replay",               1, NULL, 'P' },
         { "rows",                 1, NULL, 'r' },
+        { "resume",               1, NULL, 'R' },
+        { "rule",                 1, NULL, 'u' },
+        { "seed",                 1, NULL, 'S' },
+        { "speed",                1, NULL, 's' },
+        { "threads",              1, NULL, 't' },
+        { "topology",             1, NULL, 'T' },
+        { "verify",               0, NULL, 'v' },
         { 0,                      0, 0,    0   }
     };
     return longopts;
@@ -126,23 +319,156 @@ get_option_str(int flag) {
         return "columns";
     if (flag & OPTION_PROBABILITY)
         return "probability";
+    if (flag & OPTION_SEED)
+        return "seed";
     return "programming error: should not be reached!";
 }
 
+static const char*
+get_source_str(int flag) {
+    if (flag & OPTION_FILE)
+        return "file";
+    if (flag & OPTION_RESUME)
+        return "resume";
+    return "replay";
+}
+
 static enum options_return_value
 validate_and_set_default_options(struct options_opts *opts) {
     if (!(opts->options_set & OPTION_ALIVE_CHARACTER))
         opts->alive_character = DEFAULT_ALIVE_CHARACTER;
     if (!(opts->options_set & OPTION_NOT_ALIVE_CHARACTER))
         opts->not_alive_character = DEFAULT_NOT_ALIVE_CHARACTER;
+    if (!opts->threads)
+        opts->threads = 1;
+    if (!(opts->options_set & OPTION_SPEED))
+        opts->speed = DEFAULT_SPEED;
+    if (opts->stats_every && !opts->stats_json) {
+        fprintf(stderr, "option stats-every needs stats-json\n");
+        return OPTIONS_ERROR;
+    }
+    if (!opts->stats_every)
+        opts->stats_every = DEFAULT_STATS_EVERY;
+    // The ncurses interface always draws only what changed.
+    #ifdef HAVE_NCURSES
+        if (opts->delta) {
+            fprintf(stderr, "option delta needs the plain terminal "
+                "display\n");
+            return OPTIONS_ERROR;
+        }
+    #endif
+
+    if (opts->soups) {
+        if (opts->options_set & OPTION_SOURCES) {
+            fprintf(stderr, "options soups and %s are mutually exclusive\n",
+                get_source_str(opts->options_set));
+            return OPTIONS_ERROR;
+        }
+        if (opts->checkpoint_every || opts->stats || opts->stats_json ||
+                opts->record) {
+            fprintf(stderr, "options soups and %s are mutually exclusive\n",
+                opts->checkpoint_every ? "checkpoint-every" :
+                opts->record ? "record" : "stats");
+            return OPTIONS_ERROR;
+        }
+        opts->no_display = true;
+        if (!opts->cycle_window)
+            opts->cycle_window = DEFAULT_SOUP_CYCLES;
+    }
+
+    // A checkpoint has the topology of the run that wrote it.
+    if (opts->resume && (opts->options_set & OPTION_TOPOLOGY)) {
+        fprintf(stderr, "options resume and topology are mutually "
+            "exclusive\n");
+        return OPTIONS_ERROR;
+    }
+
+    if (opts->checkpoint_every && (opts->engine == OPTIONS_ENGINE_HASHLIFE ||
+            opts->engine == OPTIONS_ENGINE_SPARSE)) {
+        fprintf(stderr, "option checkpoint-every needs the bitwise or scalar "
+            "engine\n");
+        return OPTIONS_ERROR;
+    }
+
+    if (opts->record && (opts->engine == OPTIONS_ENGINE_HASHLIFE ||
+            opts->engine == OPTIONS_ENGINE_SPARSE)) {
+        fprintf(stderr, "option record needs the bitwise or scalar engine\n");
+        return OPTIONS_ERROR;
+    }
+    if (opts->seek && !opts->replay) {
+        fprintf(stderr, "option seek needs replay\n");
+        return OPTIONS_ERROR;
+    }
+    if (opts->replay) {
+        // A recording has the rule and topology of the run that made it.
+        if (opts->record || opts->rule_set ||
+                (opts->options_set & OPTION_TOPOLOGY)) {
+            fprintf(stderr, "options replay and %s are mutually exclusive\n",
+                opts->record ? "record" : opts->rule_set ? "rule" :
+                "topology");
+            return OPTIONS_ERROR;
+        }
+        if (opts->engine != OPTIONS_ENGINE_BITWISE) {
+            fprintf(stderr, "option replay needs the bitwise engine\n");
+            return OPTIONS_ERROR;
+        }
+        if (opts->verify) {
+            fprintf(stderr, "options replay and verify are mutually "
+                "exclusive\n");
+            return OPTIONS_ERROR;
+        }
+    }
+
+    if (opts->processes > 1) {
+        if (opts->engine != OPTIONS_ENGINE_BITWISE) {
+            fprintf(stderr, "option processes needs the bitwise engine\n");
+            return OPTIONS_ERROR;
+        }
+        if (opts->soups || opts->record || opts->replay) {
+            fprintf(stderr, "options processes and %s are mutually "
+                "exclusive\n", opts->soups ? "soups" :
+                opts->record ? "record" : "replay");
+            return OPTIONS_ERROR;
+        }
+    }
+
+    // The scalar engine it is verified against has edges.
+    if (opts->verify && (opts->engine == OPTIONS_ENGINE_HASHLIFE ||
+            opts->engine == OPTIONS_ENGINE_SPARSE)) {
+        fprintf(stderr, "option verify needs the bitwise or scalar engine\n");
+        return OPTIONS_ERROR;
+    }
+    if (opts->block > 1 && opts->engine != OPTIONS_ENGINE_BITWISE) {
+        fprintf(stderr, "option block needs the bitwise engine\n");
+        return OPTIONS_ERROR;
+    }
+    if (opts->block > BITGRID_MAX_BLOCK) {
+        fprintf(stderr, "option block is at most %d\n", BITGRID_MAX_BLOCK);
+        return OPTIONS_ERROR;
+    }
+
+    if (opts->topology == OPTIONS_TOPOLOGY_TORUS &&
+            (opts->engine == OPTIONS_ENGINE_HASHLIFE ||
+             opts->engine == OPTIONS_ENGINE_SPARSE)) {
+        fprintf(stderr, "topology torus needs the bitwise or scalar "
+            "engine\n");
+        return OPTIONS_ERROR;
+    }
 
-    if (opts->options_set & OPTION_FILE) {
+    const int sources = opts->options_set & OPTION_SOURCES;
+    if (sources & (sources - 1)) {
+        fprintf(stderr, "options %s and %s are mutually exclusive\n",
+            get_source_str(sources), get_source_str(sources & (sources - 1)));
+        return OPTIONS_ERROR;
+    }
+    if (sources) {
         int flag = (opts->options_set & OPTION_ROWS)    |
                    (opts->options_set & OPTION_COLUMNS) |
-                   (opts->options_set & OPTION_PROBABILITY);
+                   (opts->options_set & OPTION_PROBABILITY) |
+                   (opts->options_set & OPTION_SEED);
         if (flag) {
-            fprintf(stderr, "options file and %s are mutually exclusive\n",
-                get_option_str(flag));
+            fprintf(stderr, "options %s and %s are mutually exclusive\n",
+                get_source_str(sources), get_option_str(flag));
             return OPTIONS_ERROR;
         }
     }
@@ -176,7 +502,8 @@ options_init(struct options_opts *opts) {
 
 enum options_return_value
 options_getopt(int argc, char **argv, struct options_opts *opts) {
-    const char *shortopts = "a:c:f:hn:p:r:";
+    const char *shortopts =
+        "a:b:B:c:C:dDe:f:F:g:G:hij:J:k:K:m:n:o:p:P:r:R:s:S:t:T:u:v";
     struct option *longopts = init_longopts();
 
     const char *error = NULL;
@@ -190,18 +517,74 @@ options_getopt(int argc, char **argv, struct options_opts *opts) {
                     OPTIONS_ERROR);
                 opts->options_set |= OPTION_ALIVE_CHARACTER;
                 break;
+            case 'b':
+                read_int_arg(optarg, &(opts->soups), &error);
+                HANDLE_ERROR(error, "option soups %s\n", OPTIONS_ERROR);
+                break;
+            case 'B':
+                read_int_arg(optarg, &(opts->block), &error);
+                HANDLE_ERROR(error, "option block %s\n", OPTIONS_ERROR);
+                break;
             case 'c':
                 read_int_arg(optarg, &(opts->columns), &error);
                 HANDLE_ERROR(error, "option columns %s\n", OPTIONS_ERROR);
                 opts->options_set |= OPTION_COLUMNS;
                 break;
+            case 'C':
+                read_int_arg(optarg, &(opts->cycle_window), &error);
+                HANDLE_ERROR(error, "option cycles %s\n", OPTIONS_ERROR);
+                break;
+            case 'd':
+                opts->no_display = true;
+                break;
+            case 'D':
+                opts->delta = true;
+                break;
+            case 'e':
+                read_engine_arg(optarg, &opts->engine, &error);
+                HANDLE_ERROR(error, "option engine %s\n", OPTIONS_ERROR);
+                break;
             case 'f':
                 opts->file = optarg;
                 opts->options_set |= OPTION_FILE;
                 break;
+            case 'F':
+                read_format_arg(optarg, &opts->format, &error);
+                HANDLE_ERROR(error, "option format %s\n", OPTIONS_ERROR);
+                break;
+            case 'g':
+                read_int_arg(optarg, &(opts->generations), &error);
+                HANDLE_ERROR(error, "option generations %s\n", OPTIONS_ERROR);
+                break;
+            case 'G':
+                read_int_arg(optarg, &(opts->seek), &error);
+                HANDLE_ERROR(error, "option seek %s\n", OPTIONS_ERROR);
+                break;
             case 'h':
                 print_help(argv[0]);
                 return OPTIONS_HELP;
+            case 'i':
+                opts->stats = true;
+                break;
+            case 'j':
+                opts->stats_json = optarg;
+                break;
+            case 'J':
+                read_int_arg(optarg, &(opts->stats_every), &error);
+                HANDLE_ERROR(error, "option stats-every %s\n", OPTIONS_ERROR);
+                break;
+            case 'k':
+                opts->checkpoint = optarg;
+                break;
+            case 'K':
+                read_int_arg(optarg, &(opts->checkpoint_every), &error);
+                HANDLE_ERROR(error, "option checkpoint-every %s\n",
+                    OPTIONS_ERROR);
+                break;
+            case 'm':
+                read_int_arg(optarg, &(opts->processes), &error);
+                HANDLE_ERROR(error, "option processes %s\n", OPTIONS_ERROR);
+                break;
             case 'n':
                 first_wide_char_in_str(optarg, &opts->not_alive_character,
                     &error);
@@ -209,16 +592,54 @@ options_getopt(int argc, char **argv, struct options_opts *opts) {
                     "option not-alive-character %s\n", OPTIONS_ERROR);
                 opts->options_set |= OPTION_NOT_ALIVE_CHARACTER;
                 break;
+            case 'o':
+                opts->record = optarg;
+                break;
             case 'p':
                 read_double_arg(optarg, &(opts->probability), &error);
                 HANDLE_ERROR(error, "option probability %s\n", OPTIONS_ERROR);
                 opts->options_set |= OPTION_PROBABILITY;
                 break;
+            case 'P':
+                opts->replay = optarg;
+                opts->options_set |= OPTION_REPLAY;
+                break;
             case 'r':
                 read_int_arg(optarg, &(opts->rows), &error);
                 HANDLE_ERROR(error, "option rows %s\n", OPTIONS_ERROR);
                 opts->options_set |= OPTION_ROWS;
                 break;
+            case 'R':
+                opts->resume = optarg;
+                opts->options_set |= OPTION_RESUME;
+                break;
+            case 's':
+                read_speed_arg(optarg, &opts->speed, &error);
+                HANDLE_ERROR(error, "option speed %s\n", OPTIONS_ERROR);
+                opts->options_set |= OPTION_SPEED;
+                break;
+            case 'S':
+                read_seed_arg(optarg, &opts->seed, &error);
+                HANDLE_ERROR(error, "option seed %s\n", OPTIONS_ERROR);
+                opts->options_set |= OPTION_SEED;
+                break;
+            case 't':
+                read_int_arg(optarg, &(opts->threads), &error);
+                HANDLE_ERROR(error, "option threads %s\n", OPTIONS_ERROR);
+                break;
+            case 'T':
+                read_topology_arg(optarg, &opts->topology, &error);
+                HANDLE_ERROR(error, "option topology %s\n", OPTIONS_ERROR);
+                opts->options_set |= OPTION_TOPOLOGY;
+                break;
+            case 'u':
+                read_rule_arg(optarg, &opts->rule, &error);
+                HANDLE_ERROR(error, "option rule %s\n", OPTIONS_ERROR);
+                opts->rule_set = true;
+                break;
+            case 'v':
+                opts->verify = true;
+                break;
             case '?':
                 return OPTIONS_ERROR;
         }
@@ -1,12 +1,67 @@
 #ifndef OPTIONS_H
     #define OPTIONS_H
 #include <wchar.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "rule.h"
+
+enum options_engine {
+    OPTIONS_ENGINE_BITWISE, OPTIONS_ENGINE_SCALAR, OPTIONS_ENGINE_HASHLIFE,
+    OPTIONS_ENGINE_SPARSE
+};
+
+enum options_topology {
+    OPTIONS_TOPOLOGY_BOUNDED, OPTIONS_TOPOLOGY_TORUS
+};
+
+enum options_format {
+    OPTIONS_FORMAT_AUTO, OPTIONS_FORMAT_PLAIN, OPTIONS_FORMAT_RLE,
+    OPTIONS_FORMAT_LIFE106
+};
 
 struct options_opts {
     int rows, columns;
     double probability;
+    // Seed of the random table, 0 for one from the time.
+    uint64_t seed;
     wint_t alive_character, not_alive_character;
     char *file;
+    // Checkpoint to continue from, and to write every checkpoint_every
+    // generations.
+    char *resume, *checkpoint;
+    int checkpoint_every;
+    // Recording to write every generation into, or to play back from
+    // generation seek on instead of stepping.
+    char *record, *replay;
+    int seek;
+    enum options_format format;
+    enum options_engine engine;
+    enum options_topology topology;
+    // Set by the option, otherwise the rule of the pattern or Conway's.
+    struct rule rule;
+    bool rule_set;
+    // Number of generations to run, 0 runs until the table is stable.
+    int generations;
+    int threads;
+    // Processes stepping a slab of the table each, with threads threads.
+    int processes;
+    // Generations advanced at a time in cache sized blocks, 0 or 1 for one.
+    int block;
+    // Generations per second on the screen, 0 as fast as possible.
+    int speed;
+    // Generations looked back at for cycles, 0 doesn't look for them.
+    int cycle_window;
+    // Random tables to run one by one until they repeat, 0 runs one table.
+    int soups;
+    bool no_display, delta;
+    // Step the scalar engine alongside the one chosen and stop where they
+    // differ.
+    bool verify;
+    // Print the stats at exit, and every stats_every generations into the
+    // stats_json file.
+    bool stats;
+    char *stats_json;
+    int stats_every;
     int options_set;
 };
 
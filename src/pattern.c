@@ -0,0 +1,309 @@
+#include "pattern.h"
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#define READER_BUFFER_SIZE 65536
+#define LINE_SIZE 256
+#define INITIAL_CELLS 1024
+
+/* Reads bytes from a file through a buffer of its own, so the parsers can
+ * look at one byte at a time cheaply. */
+struct reader {
+    FILE *fp;
+    size_t pos, len;
+    unsigned char buf[READER_BUFFER_SIZE];
+};
+
+struct cell {
+    long y, x;
+};
+
+static bool
+fill(struct reader *r) {
+    r->pos = 0;
+    r->len = fread(r->buf, 1, sizeof(r->buf), r->fp);
+    return r->len > 0;
+}
+
+static inline int
+next_byte(struct reader *r) {
+    if (r->pos == r->len && !fill(r))
+        return EOF;
+    return r->buf[r->pos++];
+}
+
+static inline int
+peek_byte(struct reader *r) {
+    if (r->pos == r->len && !fill(r))
+        return EOF;
+    return r->buf[r->pos];
+}
+
+/* Reads a line without the line ending, cutting it to size - 1 bytes.
+ * Returns false at the end of the file. */
+static bool
+read_line(struct reader *r, char *line, size_t size) {
+    if (peek_byte(r) == EOF)
+        return false;
+    size_t n = 0;
+    int c;
+    while ((c = next_byte(r)) != EOF && c != '\n') {
+        if (n + 1 < size)
+            line[n++] = c;
+    }
+    if (n > 0 && line[n - 1] == '\r')
+        n--;
+    line[n] = '\0';
+    return true;
+}
+
+static char*
+trim(char *s) {
+    while (isspace((unsigned char) *s))
+        s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char) end[-1]))
+        end--;
+    *end = '\0';
+    return s;
+}
+
+static bool
+parse_dimension(const char *s, int *result) {
+    char *endptr;
+    errno = 0;
+    long l = strtol(s, &endptr, 10);
+    if (*s == '\0' || *endptr != '\0' || errno == ERANGE || l <= 0 ||
+            l > INT_MAX)
+        return false;
+    *result = l;
+    return true;
+}
+
+/* Parses a header like "x = 3, y = 2, rule = B3/S23". */
+static bool
+parse_rle_header(char *line, int *rows, int *columns, struct rule *rule) {
+    char *item = line;
+    while (item) {
+        char *next = strchr(item, ',');
+        if (next)
+            *next++ = '\0';
+        char *equals = strchr(item, '=');
+        if (!equals)
+            goto invalid;
+        *equals = '\0';
+        const char *key = trim(item), *value = trim(equals + 1);
+
+        if (strcmp(key, "x") == 0) {
+            if (!parse_dimension(value, columns))
+                goto invalid;
+        }
+        else if (strcmp(key, "y") == 0) {
+            if (!parse_dimension(value, rows))
+                goto invalid;
+        }
+        else if (strcmp(key, "rule") == 0 && !rule_parse(value, rule)) {
+            fprintf(stderr, "unsupported rule: %s\n", value);
+            return false;
+        }
+        item = next;
+    }
+    if (*rows > 0 && *columns > 0)
+        return true;
+
+    invalid:
+        fprintf(stderr, "invalid RLE header\n");
+        return false;
+}
+
+static bool
+allocate_cleared_table(struct gol *g, int rows, int columns) {
+    const size_t objects = (size_t) rows * columns;
+    g->table = gol_allocate_table(objects);
+    if (!g->table) {
+        fprintf(stderr, "memory error\n");
+        return false;
+    }
+    memset(g->table, 0, objects * sizeof(bool));
+    g->rows = rows;
+    g->columns = columns;
+    return true;
+}
+
+/* Decodes runs like "3o2b$" straight into the table. Any letter but b is an
+ * alive state. */
+static bool
+read_rle_cells(struct reader *r, struct gol *g) {
+    long count = 0, y = 0, x = 0;
+    int c;
+    while ((c = next_byte(r)) != EOF && c != '!') {
+        if (isdigit(c)) {
+            count = count * 10 + c - '0';
+            if (count > INT_MAX) {
+                fprintf(stderr, "run too long\n");
+                return false;
+            }
+            continue;
+        }
+        if (isspace(c))
+            continue;
+
+        const long n = count ? count : 1;
+        count = 0;
+        if (c == '$') {
+            y += n;
+            x = 0;
+        }
+        else if (c == 'b')
+            x += n;
+        else if (isalpha(c)) {
+            if (y >= g->rows || x + n > g->columns) {
+                fprintf(stderr, "pattern larger than its header\n");
+                return false;
+            }
+            memset(g->table + y * g->columns + x, true, n * sizeof(bool));
+            x += n;
+        }
+        else {
+            fprintf(stderr, "illegal character\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool
+read_rle(struct reader *r, struct gol *g) {
+    char line[LINE_SIZE];
+    bool header = false;
+    while (!header && read_line(r, line, sizeof(line))) {
+        char *s = trim(line);
+        if (*s == '#' || *s == '\0')
+            continue;
+        int rows = 0, columns = 0;
+        if (!parse_rle_header(s, &rows, &columns, &g->rule))
+            return false;
+        if (!allocate_cleared_table(g, rows, columns))
+            return false;
+        header = true;
+    }
+    if (!header) {
+        fprintf(stderr, "no RLE header\n");
+        return false;
+    }
+    return read_rle_cells(r, g);
+}
+
+static bool
+parse_coordinates(const char *s, struct cell *cell) {
+    char *endptr;
+    errno = 0;
+    cell->x = strtol(s, &endptr, 10);
+    if (endptr == s || errno == ERANGE)
+        return false;
+    s = endptr;
+    cell->y = strtol(s, &endptr, 10);
+    if (endptr == s || errno == ERANGE)
+        return false;
+    return *trim(endptr) == '\0';
+}
+
+/* Life 1.06 lists the coordinates of alive cells, so they are collected
+ * first to know the size of the table. */
+static bool
+read_life106(struct reader *r, struct gol *g) {
+    char line[LINE_SIZE];
+    size_t n = 0, capacity = INITIAL_CELLS;
+    struct cell *cells = malloc(sizeof(*cells) * capacity);
+    bool retval = false;
+    if (!cells) {
+        fprintf(stderr, "memory error\n");
+        return false;
+    }
+
+    struct cell min = { LONG_MAX, LONG_MAX }, max = { LONG_MIN, LONG_MIN };
+    while (read_line(r, line, sizeof(line))) {
+        char *s = trim(line);
+        if (*s == '#' || *s == '\0')
+            continue;
+        if (n == capacity) {
+            struct cell *temp = realloc(cells, sizeof(*cells) * capacity * 2);
+            if (!temp) {
+                fprintf(stderr, "memory error\n");
+                goto end;
+            }
+            cells = temp;
+            capacity *= 2;
+        }
+        if (!parse_coordinates(s, &cells[n])) {
+            fprintf(stderr, "invalid coordinates\n");
+            goto end;
+        }
+        if (cells[n].y < min.y)
+            min.y = cells[n].y;
+        if (cells[n].x < min.x)
+            min.x = cells[n].x;
+        if (cells[n].y > max.y)
+            max.y = cells[n].y;
+        if (cells[n].x > max.x)
+            max.x = cells[n].x;
+        n++;
+    }
+    if (n == 0) {
+        fprintf(stderr, "empty pattern\n");
+        goto end;
+    }
+    // In unsigned long, as the coordinates can be far enough apart to
+    // overflow a long.
+    if ((unsigned long) max.y - (unsigned long) min.y >= INT_MAX ||
+            (unsigned long) max.x - (unsigned long) min.x >= INT_MAX) {
+        fprintf(stderr, "pattern too large\n");
+        goto end;
+    }
+    if (!allocate_cleared_table(g, max.y - min.y + 1, max.x - min.x + 1))
+        goto end;
+    for (size_t i = 0; i < n; i++)
+        g->table[(cells[i].y - min.y) * g->columns + cells[i].x - min.x] = true;
+    retval = true;
+
+    end:
+        free(cells);
+        return retval;
+}
+
+static bool
+has_suffix(const char *s, const char *suffix) {
+    size_t len = strlen(s), suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+enum options_format
+pattern_guess_format(const char *file) {
+    if (has_suffix(file, ".rle"))
+        return OPTIONS_FORMAT_RLE;
+    if (has_suffix(file, ".lif") || has_suffix(file, ".life"))
+        return OPTIONS_FORMAT_LIFE106;
+    return OPTIONS_FORMAT_PLAIN;
+}
+
+bool
+pattern_read(FILE *fp, enum options_format format, struct gol *g) {
+    struct reader *r = malloc(sizeof(*r));
+    if (!r) {
+        fprintf(stderr, "memory error\n");
+        return false;
+    }
+    r->fp = fp;
+    r->pos = r->len = 0;
+
+    bool retval = format == OPTIONS_FORMAT_RLE ? read_rle(r, g) :
+                                                 read_life106(r, g);
+    if (retval && ferror(fp)) {
+        fprintf(stderr, "fread: %s\n", strerror(errno));
+        retval = false;
+    }
+    free(r);
+    return retval;
+}
@@ -0,0 +1,18 @@
+#ifndef PATTERN_H
+    #define PATTERN_H
+#include "gol.h"
+#include "options.h"
+#include <stdio.h>
+
+/* Guesses the format of a pattern file from its name: .rle is RLE, .lif and
+ * .life are Life 1.06 and everything else is plain text. */
+enum options_format
+pattern_guess_format(const char *file);
+
+/* Reads an RLE or a Life 1.06 pattern into the table of g and sets its rows
+ * and columns, and its rule if an RLE header has one. Prints an error and
+ * returns false on failure. */
+bool
+pattern_read(FILE *fp, enum options_format format, struct gol *g);
+
+#endif // PATTERN_H
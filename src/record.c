@@ -0,0 +1,671 @@
+#include "record.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define BYTE_ORDER_MARK 0x01020304
+#define WORD_BITS 64
+// Frames are handed to the writer this many bytes at a time.
+#define CHUNK_SIZE (1 << 20)
+// Type, generation and size of a frame at most.
+#define FRAME_HEADER_SIZE 21
+
+struct chunk {
+    struct chunk *next;
+    size_t size, capacity;
+    uint8_t *data;
+};
+
+struct buffer {
+    uint8_t *data;
+    size_t size, capacity;
+};
+
+/* The pairs of the rows of a worker's band. */
+struct band {
+    struct buffer body;
+    uint64_t *row;
+    // Index of the first word in the body and of the one after the last.
+    uint64_t first, next_index;
+    // Size of the skip before the first word.
+    size_t head;
+    bool failed;
+};
+
+struct recorder {
+    FILE *fp;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    // Chunks waiting for the writer, under the mutex.
+    struct chunk *first, *last;
+    bool quit;
+    // Set when something couldn't be recorded, after which nothing is.
+    bool failed;
+    // The chunk being filled and the body of the frame being encoded.
+    struct chunk *chunk;
+    struct buffer body;
+    long generation;
+    // The workers encode a band each, joined into the body.
+    struct workers *workers;
+    struct band *bands;
+    size_t words_per_row;
+    // Cells of the last word of a row.
+    uint64_t tail_mask;
+};
+
+struct replay {
+    uint8_t *data;
+    size_t size;
+    const struct record_header *header;
+    // The next frame, and the end of the last whole frame.
+    const uint8_t *frame, *end;
+    size_t words_per_row;
+};
+
+static inline size_t
+words_per_row(long columns) {
+    return (columns + WORD_BITS - 1) / WORD_BITS;
+}
+
+static bool
+reserve(struct buffer *b, size_t n) {
+    if (b->size + n <= b->capacity)
+        return true;
+    size_t capacity = b->capacity ? 2 * b->capacity : 4096;
+    while (capacity < b->size + n)
+        capacity *= 2;
+    uint8_t *data = realloc(b->data, capacity);
+    if (!data)
+        return false;
+    b->data = data;
+    b->capacity = capacity;
+    return true;
+}
+
+static inline uint8_t*
+put_varint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t) v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t) v;
+    return p;
+}
+
+static bool
+read_varint(const uint8_t **p, const uint8_t *end, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        const uint8_t byte = *(*p)++;
+        *v |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static void*
+writer_thread(void *data) {
+    struct recorder *r = data;
+    bool ok = true;
+    pthread_mutex_lock(&r->mutex);
+    while (true) {
+        while (!r->first && !r->quit)
+            pthread_cond_wait(&r->cond, &r->mutex);
+        struct chunk *c = r->first;
+        if (!c)
+            break;
+        r->first = c->next;
+        if (!r->first)
+            r->last = NULL;
+        pthread_mutex_unlock(&r->mutex);
+
+        if (ok && fwrite(c->data, 1, c->size, r->fp) != c->size) {
+            fprintf(stderr, "recording: %s\n", strerror(errno));
+            ok = false;
+        }
+        free(c->data);
+        free(c);
+        pthread_mutex_lock(&r->mutex);
+    }
+    pthread_mutex_unlock(&r->mutex);
+    return NULL;
+}
+
+static void
+queue_chunk(struct recorder *r) {
+    if (!r->chunk)
+        return;
+    pthread_mutex_lock(&r->mutex);
+    if (r->last)
+        r->last->next = r->chunk;
+    else
+        r->first = r->chunk;
+    r->last = r->chunk;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->mutex);
+    r->chunk = NULL;
+}
+
+static void
+fail(struct recorder *r) {
+    fprintf(stderr, "recording: memory error, stopped at generation %ld\n",
+        r->generation);
+    r->failed = true;
+}
+
+static inline uint8_t*
+put_word(uint8_t *p, uint64_t word) {
+    int cells = 0;
+    for (uint64_t w = word; w && cells <= RECORD_SPARSE_CELLS; w &= w - 1)
+        cells++;
+    if (cells > RECORD_SPARSE_CELLS) {
+        *p++ = RECORD_DENSE;
+        memcpy(p, &word, sizeof(word));
+        return p + sizeof(word);
+    }
+    *p++ = cells;
+    for (; word; word &= word - 1)
+        *p++ = __builtin_ctzll(word);
+    return p;
+}
+
+/* Appends a pair to the body of a band for every word of a row that isn't
+ * zero. */
+static void
+add_row(const struct recorder *r, struct band *b, int y,
+        const uint64_t *words) {
+    if (b->failed)
+        return;
+    // A varint of a skip, a byte and a word at most for every word.
+    if (!reserve(&b->body, r->words_per_row * (11 + sizeof(*words)))) {
+        b->failed = true;
+        return;
+    }
+    uint8_t *p = b->body.data + b->body.size;
+    const uint64_t first = (uint64_t) y * r->words_per_row;
+    const size_t last = r->words_per_row - 1;
+    for (size_t w = 0; w <= last; w++) {
+        const uint64_t word = w == last ? words[w] & r->tail_mask : words[w];
+        if (!word)
+            continue;
+        if (p == b->body.data) {
+            b->first = first + w;
+            b->head = put_varint(p, first + w - b->next_index) - p;
+            p += b->head;
+        }
+        else {
+            p = put_varint(p, first + w - b->next_index);
+        }
+        p = put_word(p, word);
+        b->next_index = first + w + 1;
+    }
+    b->body.size = p - b->body.data;
+}
+
+struct encode_job {
+    const struct recorder *r;
+    const struct gol *g;
+    bool delta;
+};
+
+static void
+encode_job(void *data, int worker) {
+    const struct encode_job *job = data;
+    const struct gol *g = job->g;
+    struct band *b = job->r->bands + worker;
+    int from, to;
+    workers_band(g->workers, worker, g->rows, &from, &to);
+    b->body.size = 0;
+    b->next_index = (uint64_t) from * job->r->words_per_row;
+    for (int y = from; y < to; y++) {
+        if (!job->delta)
+            add_row(job->r, b, y, gol_row_words(g, y, b->row));
+        else if (gol_row_flips(g, y, b->row))
+            add_row(job->r, b, y, b->row);
+    }
+}
+
+/* Encodes the bands of the workers and joins them into the body, the skip
+ * to the first word of a band counted from the last word of the one before
+ * it. */
+static void
+encode(struct recorder *r, const struct gol *g, bool delta) {
+    if (r->failed)
+        return;
+    struct encode_job job = { .r = r, .g = g, .delta = delta };
+    workers_run(r->workers, encode_job, &job);
+
+    const int workers = workers_count(r->workers);
+    size_t size = 0;
+    for (int i = 0; i < workers; i++) {
+        if (r->bands[i].failed) {
+            fail(r);
+            return;
+        }
+        size += r->bands[i].body.size;
+    }
+    // A skip may grow by the bytes of a varint at most.
+    r->body.size = 0;
+    if (!reserve(&r->body, size + workers * 10)) {
+        fail(r);
+        return;
+    }
+    uint8_t *p = r->body.data;
+    uint64_t next_index = 0;
+    for (int i = 0; i < workers; i++) {
+        const struct band *b = r->bands + i;
+        if (!b->body.size)
+            continue;
+        p = put_varint(p, b->first - next_index);
+        memcpy(p, b->body.data + b->head, b->body.size - b->head);
+        p += b->body.size - b->head;
+        next_index = b->next_index;
+    }
+    r->body.size = p - r->body.data;
+}
+
+/* Moves the body into the chunk behind its header. */
+static void
+add_frame(struct recorder *r, uint8_t type) {
+    if (r->failed)
+        return;
+    const size_t size = FRAME_HEADER_SIZE + r->body.size;
+    if (!r->chunk) {
+        r->chunk = malloc(sizeof(*r->chunk));
+        if (r->chunk) {
+            memset(r->chunk, 0, sizeof(*r->chunk));
+            r->chunk->capacity = size > CHUNK_SIZE ? size : CHUNK_SIZE;
+            r->chunk->data = malloc(r->chunk->capacity);
+        }
+        if (!r->chunk || !r->chunk->data) {
+            free(r->chunk);
+            r->chunk = NULL;
+            fail(r);
+            return;
+        }
+    }
+    struct chunk *c = r->chunk;
+    if (c->size + size > c->capacity) {
+        queue_chunk(r);
+        add_frame(r, type);
+        return;
+    }
+    uint8_t *p = c->data + c->size;
+    *p++ = type;
+    p = put_varint(p, r->generation);
+    p = put_varint(p, r->body.size);
+    memcpy(p, r->body.data, r->body.size);
+    c->size = p + r->body.size - c->data;
+    r->body.size = 0;
+    if (c->size >= CHUNK_SIZE)
+        queue_chunk(r);
+}
+
+static void
+add_keyframe(struct recorder *r, const struct gol *g) {
+    encode(r, g, false);
+    add_frame(r, RECORD_KEYFRAME);
+}
+
+static void
+free_bands(struct recorder *r) {
+    if (!r->bands)
+        return;
+    for (int i = 0; i < workers_count(r->workers); i++) {
+        free(r->bands[i].body.data);
+        free(r->bands[i].row);
+    }
+    free(r->bands);
+}
+
+static bool
+init_bands(struct recorder *r) {
+    const int workers = workers_count(r->workers);
+    r->bands = malloc(sizeof(*r->bands) * workers);
+    if (!r->bands)
+        return false;
+    memset(r->bands, 0, sizeof(*r->bands) * workers);
+    for (int i = 0; i < workers; i++) {
+        r->bands[i].row = malloc(sizeof(uint64_t) * r->words_per_row);
+        if (!r->bands[i].row)
+            return false;
+    }
+    return true;
+}
+
+struct recorder*
+recorder_init(const char *file, const struct gol *g) {
+    struct recorder *r = malloc(sizeof(*r));
+    if (!r) {
+        fprintf(stderr, "memory error\n");
+        return NULL;
+    }
+    memset(r, 0, sizeof(*r));
+    r->words_per_row = words_per_row(g->columns);
+    r->tail_mask = g->columns % WORD_BITS ?
+        (UINT64_C(1) << g->columns % WORD_BITS) - 1 : ~UINT64_C(0);
+    r->workers = g->workers;
+    if (!init_bands(r)) {
+        fprintf(stderr, "memory error\n");
+        free_bands(r);
+        free(r);
+        return NULL;
+    }
+    r->fp = fopen(file, "wb");
+    if (!r->fp) {
+        fprintf(stderr, "can't open %s: %s\n", file, strerror(errno));
+        free_bands(r);
+        free(r);
+        return NULL;
+    }
+
+    struct record_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC));
+    h.version = RECORD_VERSION;
+    h.byte_order = BYTE_ORDER_MARK;
+    h.flags = g->torus ? RECORD_TORUS : 0;
+    h.rows = g->rows;
+    h.columns = g->columns;
+    h.generation = g->generation;
+    h.seed = g->seed;
+    rule_format(g->rule, h.rule);
+    if (fwrite(&h, sizeof(h), 1, r->fp) != 1) {
+        fprintf(stderr, "recording: %s\n", strerror(errno));
+        fclose(r->fp);
+        free_bands(r);
+        free(r);
+        return NULL;
+    }
+
+    pthread_mutex_init(&r->mutex, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (pthread_create(&r->thread, NULL, writer_thread, r) != 0) {
+        fprintf(stderr, "can't start the recording writer\n");
+        pthread_mutex_destroy(&r->mutex);
+        pthread_cond_destroy(&r->cond);
+        fclose(r->fp);
+        free_bands(r);
+        free(r);
+        return NULL;
+    }
+    r->generation = g->generation;
+    add_keyframe(r, g);
+    return r;
+}
+
+void
+recorder_add(struct recorder *r, const struct gol *g) {
+    r->generation = g->generation;
+    encode(r, g, true);
+    add_frame(r, RECORD_DELTA);
+    if (g->generation % RECORD_KEYFRAME_EVERY == 0)
+        add_keyframe(r, g);
+}
+
+void
+recorder_free(struct recorder *r) {
+    if (!r)
+        return;
+    queue_chunk(r);
+    pthread_mutex_lock(&r->mutex);
+    r->quit = true;
+    pthread_cond_signal(&r->cond);
+    pthread_mutex_unlock(&r->mutex);
+    pthread_join(r->thread, NULL);
+    pthread_mutex_destroy(&r->mutex);
+    pthread_cond_destroy(&r->cond);
+    if (fclose(r->fp) != 0)
+        fprintf(stderr, "recording: %s\n", strerror(errno));
+    free(r->body.data);
+    free_bands(r);
+    free(r);
+}
+
+/* Reads the header of a frame and moves past it. Returns false at the end
+ * of the recording. */
+static bool
+read_frame(const struct replay *p, const uint8_t **frame, uint8_t *type,
+           long *generation, const uint8_t **body, size_t *size) {
+    const uint8_t *q = *frame;
+    uint64_t g, n;
+    if (q >= p->end)
+        return false;
+    *type = *q++;
+    if (!read_varint(&q, p->end, &g) || !read_varint(&q, p->end, &n) ||
+            n > (size_t) (p->end - q))
+        return false;
+    *generation = g;
+    *body = q;
+    *size = n;
+    *frame = q + n;
+    return true;
+}
+
+static bool
+read_word(const uint8_t **p, const uint8_t *end, uint64_t *word) {
+    if (*p >= end)
+        return false;
+    const uint8_t cells = *(*p)++;
+    if (cells == RECORD_DENSE) {
+        if ((size_t) (end - *p) < sizeof(*word))
+            return false;
+        memcpy(word, *p, sizeof(*word));
+        *p += sizeof(*word);
+        return true;
+    }
+    if (cells > RECORD_SPARSE_CELLS || end - *p < cells)
+        return false;
+    *word = 0;
+    for (int i = 0; i < cells; i++) {
+        const uint8_t bit = *(*p)++;
+        if (bit >= WORD_BITS)
+            return false;
+        *word |= UINT64_C(1) << bit;
+    }
+    return true;
+}
+
+/* Flips the words of a body into the grid. Returns false if the body is
+ * corrupt. */
+static bool
+apply_body(const struct replay *p, struct gol *g, const uint8_t *body,
+           size_t size, long *flipped) {
+    const uint8_t *end = body + size;
+    const uint64_t words = (uint64_t) g->rows * p->words_per_row;
+    uint64_t index = 0, skip, word;
+    *flipped = 0;
+    while (body < end) {
+        if (!read_varint(&body, end, &skip) || skip >= words - index ||
+                !read_word(&body, end, &word))
+            return false;
+        index += skip;
+        const int y = index / p->words_per_row;
+        const int w = index % p->words_per_row;
+        if (w == (int) p->words_per_row - 1)
+            word &= g->bits->tail_mask;
+        bitgrid_flip(g->bits, y, w, word);
+        *flipped += __builtin_popcountll(word);
+        index++;
+    }
+    return true;
+}
+
+/* The whole frames, so that a recording cut short when the game was killed
+ * plays to its last whole frame. */
+static const uint8_t*
+find_end(struct replay *p) {
+    p->end = p->data + p->size;
+    const uint8_t *frame = p->frame, *body;
+    uint8_t type;
+    long generation;
+    size_t size;
+    while (read_frame(p, &frame, &type, &generation, &body, &size))
+        p->frame = frame;
+    const uint8_t *end = p->frame;
+    p->frame = (const uint8_t*) (p->header + 1);
+    return end;
+}
+
+static bool
+valid_header(const struct record_header *h, struct rule *rule) {
+    if (memcmp(h->magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) != 0 ||
+            h->version != RECORD_VERSION) {
+        fprintf(stderr, "not a recording\n");
+        return false;
+    }
+    if (h->byte_order != BYTE_ORDER_MARK) {
+        fprintf(stderr, "recording has a different byte order\n");
+        return false;
+    }
+    char rule_string[RECORD_RULE_SIZE + 1];
+    memcpy(rule_string, h->rule, RECORD_RULE_SIZE);
+    rule_string[RECORD_RULE_SIZE] = '\0';
+    if (!rule_parse(rule_string, rule)) {
+        fprintf(stderr, "unsupported rule: %s\n", rule_string);
+        return false;
+    }
+    if (h->rows <= 0 || h->rows > INT_MAX || h->columns <= 0 ||
+            h->columns > INT_MAX || h->generation < 0 ||
+            h->flags & ~RECORD_TORUS) {
+        fprintf(stderr, "corrupt recording\n");
+        return false;
+    }
+    return true;
+}
+
+/* Finds the last keyframe at or before the generation, or the first one,
+ * and plays on from it. */
+static bool
+seek(struct replay *p, struct gol *g, long target) {
+    const uint8_t *frame = p->frame, *body, *keyframe = NULL;
+    uint8_t type;
+    long generation;
+    size_t size;
+    while (read_frame(p, &frame, &type, &generation, &body, &size) &&
+            (!keyframe || generation <= target)) {
+        if (type == RECORD_KEYFRAME)
+            keyframe = frame;
+    }
+    if (!keyframe) {
+        fprintf(stderr, "corrupt recording\n");
+        return false;
+    }
+
+    // The keyframe again, now that it's known which one.
+    const uint8_t *start = p->frame;
+    while (read_frame(p, &start, &type, &generation, &body, &size) &&
+            start != keyframe)
+        ;
+    long flipped;
+    if (!apply_body(p, g, body, size, &flipped)) {
+        fprintf(stderr, "corrupt recording\n");
+        return false;
+    }
+    p->frame = keyframe;
+    g->generation = generation;
+    if (generation < target)
+        g->generation += replay_step(p, g, target - generation, &flipped);
+    return true;
+}
+
+struct replay*
+replay_init(const char *file, struct gol *g, long generation) {
+    struct replay *p = malloc(sizeof(*p));
+    if (!p) {
+        fprintf(stderr, "memory error\n");
+        return NULL;
+    }
+    memset(p, 0, sizeof(*p));
+    p->data = MAP_FAILED;
+    int fd = open(file, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Can't open file: %s\n", strerror(errno));
+        goto error;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        fprintf(stderr, "fstat: %s\n", strerror(errno));
+        close(fd);
+        goto error;
+    }
+    p->size = st.st_size;
+    if (p->size < sizeof(struct record_header)) {
+        fprintf(stderr, "not a recording\n");
+        close(fd);
+        goto error;
+    }
+    p->data = mmap(NULL, p->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p->data == MAP_FAILED) {
+        fprintf(stderr, "mmap: %s\n", strerror(errno));
+        goto error;
+    }
+
+    p->header = (const struct record_header*) p->data;
+    if (!valid_header(p->header, &g->rule))
+        goto error;
+    g->rows = p->header->rows;
+    g->columns = p->header->columns;
+    g->seed = p->header->seed;
+    g->torus = p->header->flags & RECORD_TORUS;
+    p->words_per_row = words_per_row(g->columns);
+    p->frame = (const uint8_t*) (p->header + 1);
+    p->end = find_end(p);
+
+    g->bits = bitgrid_init(g->rows, g->columns, g->rule, g->torus);
+    if (!g->bits) {
+        fprintf(stderr, "memory error\n");
+        goto error;
+    }
+    if (!seek(p, g, generation))
+        goto error;
+    return p;
+
+    error:
+        replay_free(p);
+        return NULL;
+}
+
+void
+replay_free(struct replay *p) {
+    if (!p)
+        return;
+    if (p->data != MAP_FAILED)
+        munmap(p->data, p->size);
+    free(p);
+}
+
+long
+replay_step(struct replay *p, struct gol *g, long n, long *flipped) {
+    long played = 0;
+    uint8_t type;
+    long generation;
+    const uint8_t *body;
+    size_t size;
+    *flipped = 0;
+    while (played < n) {
+        const uint8_t *frame = p->frame;
+        if (!read_frame(p, &frame, &type, &generation, &body, &size))
+            break;
+        if (type == RECORD_DELTA) {
+            if (generation != g->generation + played + 1 ||
+                    !apply_body(p, g, body, size, flipped)) {
+                fprintf(stderr, "corrupt recording at generation %ld\n",
+                    generation);
+                break;
+            }
+            played++;
+        }
+        p->frame = frame;
+    }
+    return played;
+}
@@ -0,0 +1,83 @@
+#ifndef RECORD_H
+    #define RECORD_H
+#include "gol.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A recording is a header followed by frames. A frame is a byte telling its
+ * type, the generation it's of and the size of its body, both varints, and
+ * the body: pairs of a varint count of the words skipped since the last pair
+ * and a word. A word stands for 64 cells of a row like in a snapshot, and
+ * its index is y * words + x / 64 where a row has words of them. A word of
+ * up to RECORD_SPARSE_CELLS cells is a byte of their number and a byte of
+ * the bit of each, one of more cells RECORD_DENSE and the word in the byte
+ * order of the machine that wrote it.
+ *
+ * The words of a delta are the cells that flipped since the generation
+ * before, and those of a keyframe the alive cells. The recording starts with
+ * a keyframe, and a keyframe follows the delta of every generation divisible
+ * by RECORD_KEYFRAME_EVERY, for seeking.
+ *
+ * RECORD_TORUS is set in the flags if the edges of the table wrap around. */
+#define RECORD_MAGIC "GOLREC"
+#define RECORD_VERSION 2
+#define RECORD_KEYFRAME 'K'
+#define RECORD_DELTA 'D'
+#define RECORD_KEYFRAME_EVERY 1000
+#define RECORD_SPARSE_CELLS 7
+#define RECORD_DENSE 0xff
+#define RECORD_RULE_SIZE 32
+#define RECORD_TORUS 1
+
+struct record_header {
+    char magic[8];
+    uint32_t version;
+    // 0x01020304 written natively, to notice a different byte order.
+    uint32_t byte_order;
+    uint32_t flags, reserved;
+    int64_t rows, columns;
+    // Generation of the first keyframe.
+    int64_t generation;
+    uint64_t seed;
+    char rule[RECORD_RULE_SIZE];
+};
+
+/* Encodes frames on the workers of the game, a band each, and has them
+ * written by a thread of its own, so the game never waits for the disk. The
+ * frames wait in memory if the disk is slower than the game. */
+struct recorder;
+
+/* Starts with the keyframe of the generation of g. Only the bitwise and
+ * scalar engines are supported. Prints an error and returns NULL on
+ * failure. */
+struct recorder*
+recorder_init(const char *file, const struct gol *g);
+
+/* Adds the delta of the generation just stepped, one after the last one
+ * added. */
+void
+recorder_add(struct recorder *r, const struct gol *g);
+
+/* Waits for the frames to be written. */
+void
+recorder_free(struct recorder *r);
+
+/* Plays a recording back into a bitgrid without stepping it. */
+struct replay;
+
+/* Maps a recording and sets up the rows, columns, topology, rule and seed of
+ * g and the cells of g->bits at a generation, or the nearest one recorded,
+ * from the keyframe before it. Prints an error and returns NULL on failure. */
+struct replay*
+replay_init(const char *file, struct gol *g, long generation);
+
+void
+replay_free(struct replay *p);
+
+/* Plays at most n generations and returns their number, fewer at the end of
+ * the recording. Stores the number of cells flipped in the last one in
+ * flipped. */
+long
+replay_step(struct replay *p, struct gol *g, long n, long *flipped);
+
+#endif // RECORD_H
@@ -0,0 +1,79 @@
+#include "rule.h"
+#include <ctype.h>
+#include <stddef.h>
+
+/* Reads the neighbor counts up to the next slash, letter or the end. */
+static const char*
+read_counts(const char *s, uint16_t *counts) {
+    for (; *s && isdigit((unsigned char) *s); s++) {
+        if (*s > '8')
+            return NULL;
+        *counts |= 1 << (*s - '0');
+    }
+    return s;
+}
+
+bool
+rule_parse(const char *s, struct rule *r) {
+    char normalized[64];
+    size_t n = 0;
+    for (; *s; s++) {
+        if (isspace((unsigned char) *s))
+            continue;
+        if (n + 1 == sizeof(normalized))
+            return false;
+        normalized[n++] = toupper((unsigned char) *s);
+    }
+    normalized[n] = '\0';
+
+    struct rule parsed = { 0, 0 };
+    const char *p = normalized;
+    if (isdigit((unsigned char) *p) || *p == '/') {
+        if (!(p = read_counts(p, &parsed.survival)) || *p++ != '/' ||
+                !(p = read_counts(p, &parsed.birth)) || *p)
+            return false;
+        *r = parsed;
+        return true;
+    }
+
+    bool birth = false, survival = false;
+    while (*p) {
+        if (*p == 'B' && !birth) {
+            birth = true;
+            p = read_counts(p + 1, &parsed.birth);
+        }
+        else if (*p == 'S' && !survival) {
+            survival = true;
+            p = read_counts(p + 1, &parsed.survival);
+        }
+        else
+            return false;
+        if (!p)
+            return false;
+        if (*p == '/' && p[1])
+            p++;
+    }
+    if (!birth || !survival)
+        return false;
+    *r = parsed;
+    return true;
+}
+
+static char*
+format_counts(char *s, uint16_t counts) {
+    for (int n = 0; n <= 8; n++) {
+        if ((counts >> n) & 1)
+            *s++ = '0' + n;
+    }
+    return s;
+}
+
+void
+rule_format(struct rule r, char *s) {
+    *s++ = 'B';
+    s = format_counts(s, r.birth);
+    *s++ = '/';
+    *s++ = 'S';
+    s = format_counts(s, r.survival);
+    *s = '\0';
+}
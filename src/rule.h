@@ -0,0 +1,62 @@
+#ifndef RULE_H
+    #define RULE_H
+#include <stdbool.h>
+#include <stdint.h>
+// "B012345678/S012345678" and the terminating null.
+#define RULE_STRING_SIZE 22
+
+/* A rule like B3/S23: bit n of birth is set if a dead cell with n alive
+ * neighbors is born, and bit n of survival if an alive cell with n alive
+ * neighbors stays alive. Both are lookup tables of nine entries. */
+struct rule {
+    uint16_t birth, survival;
+};
+
+#define RULE_CONWAY ((struct rule) { 1 << 3, 1 << 2 | 1 << 3 })
+
+/* Bit n of a table as a constant expression. */
+#define RULE_N(n) (1 << (n))
+
+/* Rules the engines have kernels of their own for, as X(name, birth,
+ * survival), which have their tables folded in. Conway's rule has the
+ * hand-written ones. */
+#define RULE_NAMED(X) \
+    X(highlife, RULE_N(3) | RULE_N(6), RULE_N(2) | RULE_N(3)) \
+    X(day_and_night, RULE_N(3) | RULE_N(6) | RULE_N(7) | RULE_N(8), \
+        RULE_N(3) | RULE_N(4) | RULE_N(6) | RULE_N(7) | RULE_N(8)) \
+    X(seeds, RULE_N(2), 0) \
+    X(life_without_death, RULE_N(3), 0x1FF) \
+    X(maze, RULE_N(3), \
+        RULE_N(1) | RULE_N(2) | RULE_N(3) | RULE_N(4) | RULE_N(5)) \
+    X(replicator, RULE_N(1) | RULE_N(3) | RULE_N(5) | RULE_N(7), \
+        RULE_N(1) | RULE_N(3) | RULE_N(5) | RULE_N(7)) \
+    X(two_by_two, RULE_N(3) | RULE_N(6), RULE_N(1) | RULE_N(2) | RULE_N(5)) \
+    X(thirty_four, RULE_N(3) | RULE_N(4), RULE_N(3) | RULE_N(4)) \
+    X(morley, RULE_N(3) | RULE_N(6) | RULE_N(8), \
+        RULE_N(2) | RULE_N(4) | RULE_N(5)) \
+    X(diamoeba, RULE_N(3) | RULE_N(5) | RULE_N(6) | RULE_N(7) | RULE_N(8), \
+        RULE_N(5) | RULE_N(6) | RULE_N(7) | RULE_N(8)) \
+    X(anneal, RULE_N(4) | RULE_N(6) | RULE_N(7) | RULE_N(8), \
+        RULE_N(3) | RULE_N(5) | RULE_N(6) | RULE_N(7) | RULE_N(8))
+
+/* Parses B36/S23, S23/B36 or 23/36, which is survival before birth. Case and
+ * white space don't matter. Returns false if s isn't a rule. */
+bool
+rule_parse(const char *s, struct rule *r);
+
+/* Writes the rule as B36/S23 into s of RULE_STRING_SIZE bytes. */
+void
+rule_format(struct rule r, char *s);
+
+static inline bool
+rule_equal(struct rule a, struct rule b) {
+    return a.birth == b.birth && a.survival == b.survival;
+}
+
+/* Whether a cell with n alive neighbors is alive in the next generation. */
+static inline bool
+rule_next(struct rule r, bool alive, int n) {
+    return ((alive ? r.survival : r.birth) >> n) & 1;
+}
+
+#endif // RULE_H
@@ -0,0 +1,349 @@
+#include "slabs.h"
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#define NODE_CPUS "/sys/devices/system/node/node%d/cpulist"
+// How long a process waits before looking whether the others are alive.
+#define WAIT_NANOSECONDS 100000000
+#define CACHE_LINE 64
+
+enum side {
+    TOP, BOTTOM
+};
+
+/* Waits until total processes have arrived. The last one to arrive bumps
+ * the phase, which the others wait on. */
+struct barrier {
+    atomic_int arrived, phase;
+    int total;
+};
+
+/* The start of the shared memory. */
+struct shared {
+    // The coordinator and the processes, once before and once after every
+    // call of slabs_step(), and the processes once every generation.
+    struct barrier command, generation;
+    atomic_bool failed;
+    // What the coordinator asks for.
+    long n;
+    bool until_stable, quit;
+    // Generations stepped, the same for all processes.
+    long generations;
+};
+
+struct slabs {
+    struct shared *shared;
+    size_t size;
+    // Cells changed by each process, for two generations in turn.
+    long *changed;
+    // Rows of the edges of each slab, for two generations in turn.
+    uint64_t *halos;
+    // Where the processes leave their slabs for the coordinator.
+    uint64_t *grid;
+    int processes, words;
+    // Which of the two generations is next.
+    int parity;
+    pid_t coordinator;
+    // The bitgrid of the coordinator, a copy of it in a slab process, and
+    // the slab processes, NULL in one of them.
+    struct bitgrid *b;
+    pid_t *children;
+    // In a slab process: its slab, from row from to row to of b.
+    int slab, from, to;
+    struct bitgrid *cells;
+    struct workers *workers;
+};
+
+static void
+futex(atomic_int *word, int op, int value, const struct timespec *timeout) {
+    syscall(SYS_futex, (int*) word, op, value, timeout, NULL, 0);
+}
+
+static void
+fail(struct slabs *s) {
+    struct shared *sh = s->shared;
+    atomic_store(&sh->failed, true);
+    atomic_fetch_add(&sh->command.phase, 1);
+    atomic_fetch_add(&sh->generation.phase, 1);
+    futex(&sh->command.phase, FUTEX_WAKE, INT_MAX, NULL);
+    futex(&sh->generation.phase, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+/* Whether every other process is still there: the children for the
+ * coordinator, the coordinator for a child. */
+static bool
+others_alive(struct slabs *s) {
+    if (!s->children)
+        return getppid() == s->coordinator;
+    for (int i = 0; i < s->processes; i++) {
+        if (s->children[i] && waitpid(s->children[i], NULL, WNOHANG) != 0) {
+            s->children[i] = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Returns false if a process failed or died. */
+static bool
+barrier_wait(struct slabs *s, struct barrier *b) {
+    struct shared *sh = s->shared;
+    const int phase = atomic_load(&b->phase);
+    if (atomic_load(&sh->failed))
+        return false;
+    if (atomic_fetch_add(&b->arrived, 1) + 1 == b->total) {
+        atomic_store(&b->arrived, 0);
+        atomic_store(&b->phase, phase + 1);
+        futex(&b->phase, FUTEX_WAKE, INT_MAX, NULL);
+        return !atomic_load(&sh->failed);
+    }
+    const struct timespec timeout = { 0, WAIT_NANOSECONDS };
+    while (atomic_load(&b->phase) == phase) {
+        futex(&b->phase, FUTEX_WAIT, phase, &timeout);
+        if (atomic_load(&b->phase) == phase && !others_alive(s))
+            fail(s);
+    }
+    return !atomic_load(&sh->failed);
+}
+
+static uint64_t*
+halo(const struct slabs *s, int parity, int slab, enum side side) {
+    return s->halos +
+        ((size_t) (parity * s->processes + slab) * 2 + side) * s->words;
+}
+
+/* Pins the process to the processors of a NUMA node, listed by the kernel
+ * like 0-3,8-11, if the machine has more than one node. Memory the process
+ * touches first is then allocated from that node. */
+static void
+pin_to_node(int slab) {
+    char path[sizeof(NODE_CPUS) + 16];
+    int nodes = 0;
+    while (true) {
+        snprintf(path, sizeof(path), NODE_CPUS, nodes);
+        if (access(path, R_OK) != 0)
+            break;
+        nodes++;
+    }
+    if (nodes < 2)
+        return;
+
+    snprintf(path, sizeof(path), NODE_CPUS, slab % nodes);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    int from, to, separator = ',';
+    while (separator == ',' && fscanf(fp, "%d", &from) == 1) {
+        to = from;
+        separator = fgetc(fp);
+        if (separator == '-' && fscanf(fp, "%d", &to) == 1)
+            separator = fgetc(fp);
+        for (int cpu = from; cpu <= to && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, &cpus);
+    }
+    fclose(fp);
+    if (CPU_COUNT(&cpus) && sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+        fprintf(stderr, "can't pin slab %d to node %d\n", slab, slab % nodes);
+}
+
+static long
+sum_changed(const struct slabs *s, int parity) {
+    long changed = 0;
+    for (int i = 0; i < s->processes; i++)
+        changed += s->changed[parity * s->processes + i];
+    return changed;
+}
+
+/* Steps the slab generation by generation. Every process hands its edges
+ * over before the barrier and takes those of its neighbors after it; the
+ * edges and the counts of a generation aren't written over until two
+ * barriers later, when everybody is done with them. All processes sum the
+ * same counts, so they agree on when to stop. */
+static bool
+step_slab(struct slabs *s) {
+    struct shared *sh = s->shared;
+    struct bitgrid *b = s->cells;
+    const bool torus = b->torus;
+    const int last = s->processes - 1;
+    const int above = s->slab > 0 ? s->slab - 1 : torus ? last : -1;
+    const int below = s->slab < last ? s->slab + 1 : torus ? 0 : -1;
+    const size_t row_size = sizeof(uint64_t) * s->words;
+    long generation = 0;
+    while (generation < sh->n) {
+        const int p = s->parity;
+        memcpy(halo(s, p, s->slab, TOP), bitgrid_row(b, 0), row_size);
+        memcpy(halo(s, p, s->slab, BOTTOM), bitgrid_row(b, b->rows - 1),
+            row_size);
+        if (!barrier_wait(s, &sh->generation))
+            return false;
+        if (generation > 0 && sh->until_stable && !sum_changed(s, 1 - p))
+            break;
+
+        bitgrid_set_halo(b, above >= 0 ? halo(s, p, above, BOTTOM) : NULL,
+            below >= 0 ? halo(s, p, below, TOP) : NULL);
+        long changed;
+        bitgrid_step(b, s->workers, 1, false, &changed);
+        s->changed[p * s->processes + s->slab] = changed;
+        s->parity = 1 - p;
+        generation++;
+    }
+    for (int y = 0; y < b->rows; y++) {
+        memcpy(s->grid + (size_t) (s->from + y) * s->words,
+            bitgrid_row(b, y), row_size);
+    }
+    if (s->slab == 0)
+        sh->generations = generation;
+    return true;
+}
+
+/* The life of a slab process, which never returns. Nothing of the
+ * coordinator is freed or flushed, it's only a copy. */
+static void
+run_slab(struct slabs *s, int slab, int threads) {
+    s->children = NULL;
+    s->slab = slab;
+    s->from = (long) s->b->rows * slab / s->processes;
+    s->to = (long) s->b->rows * (slab + 1) / s->processes;
+    pin_to_node(slab);
+
+    s->cells = bitgrid_init(s->to - s->from, s->b->columns, s->b->rule,
+        s->b->torus);
+    s->workers = workers_init(threads);
+    if (!s->cells || !s->workers) {
+        fprintf(stderr, "slab %d: memory error\n", slab);
+        fail(s);
+        _exit(EXIT_FAILURE);
+    }
+    for (int y = s->from; y < s->to; y++) {
+        memcpy(bitgrid_row(s->cells, y - s->from), bitgrid_row(s->b, y),
+            sizeof(uint64_t) * s->words);
+    }
+    bitgrid_rows_written(s->cells);
+
+    struct shared *sh = s->shared;
+    bool ok = barrier_wait(s, &sh->command);
+    while (ok && barrier_wait(s, &sh->command) && !sh->quit)
+        ok = step_slab(s) && barrier_wait(s, &sh->command);
+    _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+static size_t
+align(size_t size) {
+    return (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+}
+
+struct slabs*
+slabs_init(struct bitgrid *b, int processes, int threads) {
+    if (processes > b->rows) {
+        fprintf(stderr, "more processes than rows\n");
+        return NULL;
+    }
+    struct slabs *s = malloc(sizeof(*s));
+    if (!s) {
+        fprintf(stderr, "memory error\n");
+        return NULL;
+    }
+    memset(s, 0, sizeof(*s));
+    s->b = b;
+    s->processes = processes;
+    s->words = b->words;
+    s->coordinator = getpid();
+
+    const size_t changed = align(sizeof(*s->changed) * 2 * processes);
+    const size_t halos = align(sizeof(*s->halos) * 4 * processes * b->words);
+    const size_t grid = sizeof(*s->grid) * b->rows * b->words;
+    s->size = align(sizeof(*s->shared)) + changed + halos + grid;
+    uint8_t *shared = mmap(NULL, s->size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    s->children = calloc(processes, sizeof(*s->children));
+    if (shared == MAP_FAILED || !s->children) {
+        fprintf(stderr, "memory error\n");
+        if (shared != MAP_FAILED)
+            munmap(shared, s->size);
+        free(s->children);
+        free(s);
+        return NULL;
+    }
+    s->shared = (struct shared*) shared;
+    s->changed = (long*) (shared + align(sizeof(*s->shared)));
+    s->halos = (uint64_t*) ((uint8_t*) s->changed + changed);
+    s->grid = (uint64_t*) ((uint8_t*) s->halos + halos);
+    atomic_init(&s->shared->command.arrived, 0);
+    atomic_init(&s->shared->command.phase, 0);
+    s->shared->command.total = processes + 1;
+    atomic_init(&s->shared->generation.arrived, 0);
+    atomic_init(&s->shared->generation.phase, 0);
+    s->shared->generation.total = processes;
+    atomic_init(&s->shared->failed, false);
+
+    for (int i = 0; i < processes; i++) {
+        const pid_t pid = fork();
+        if (pid == 0)
+            run_slab(s, i, threads);
+        if (pid < 0) {
+            fprintf(stderr, "can't start slab processes: %s\n",
+                strerror(errno));
+            fail(s);
+            break;
+        }
+        s->children[i] = pid;
+    }
+    // Waits for every process to have its slab.
+    if (!barrier_wait(s, &s->shared->command)) {
+        slabs_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void
+slabs_free(struct slabs *s) {
+    if (!s)
+        return;
+    s->shared->quit = true;
+    barrier_wait(s, &s->shared->command);
+    for (int i = 0; i < s->processes; i++) {
+        if (s->children[i])
+            waitpid(s->children[i], NULL, 0);
+    }
+    munmap(s->shared, s->size);
+    free(s->children);
+    free(s);
+}
+
+long
+slabs_step(struct slabs *s, long n, bool until_stable, long *changed) {
+    struct shared *sh = s->shared;
+    *changed = 0;
+    if (n <= 0)
+        return 0;
+    sh->n = n;
+    sh->until_stable = until_stable;
+    if (!barrier_wait(s, &sh->command) || !barrier_wait(s, &sh->command))
+        return -1;
+
+    const long generations = sh->generations;
+    for (int y = 0; y < s->b->rows; y++) {
+        memcpy(bitgrid_row(s->b, y), s->grid + (size_t) y * s->words,
+            sizeof(uint64_t) * s->words);
+    }
+    bitgrid_rows_written(s->b);
+    if (generations) {
+        s->parity ^= generations & 1;
+        *changed = sum_changed(s, 1 - s->parity);
+    }
+    return generations;
+}
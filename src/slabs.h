@@ -0,0 +1,30 @@
+#ifndef SLABS_H
+    #define SLABS_H
+#include "bitgrid.h"
+#include <stdbool.h>
+
+/* Steps a bitgrid split into horizontal slabs, each in a process of its own
+ * with threads of its own. A process pins itself to a NUMA node in turn
+ * before allocating its slab, so that every slab is in the memory of the
+ * node stepping it. Every generation the processes hand the first and the
+ * last row of their slabs to their neighbors through shared memory, and
+ * wait for each other on a futex. The grid is copied back into the bitgrid
+ * of the coordinator, the process calling slabs_init(), after every call to
+ * slabs_step(). Linux only. */
+struct slabs;
+
+/* Forks a process for each slab of b. Prints an error and returns NULL on
+ * failure. */
+struct slabs*
+slabs_init(struct bitgrid *b, int processes, int threads);
+
+/* Stops the processes and waits for them. */
+void
+slabs_free(struct slabs *s);
+
+/* Same as bitgrid_step(), for the bitgrid given to slabs_init(). Returns -1
+ * if a process failed or died. */
+long
+slabs_step(struct slabs *s, long n, bool until_stable, long *changed);
+
+#endif // SLABS_H
@@ -0,0 +1,392 @@
+#include "snapshot.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define BYTE_ORDER_MARK 0x01020304
+#define WORD_BITS 64
+#define TEMP_SUFFIX ".tmp"
+
+struct snapshot_writer {
+    char *file, *temp_file;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    // Set when a checkpoint has been copied and cleared when it's written.
+    bool pending, quit;
+    struct snapshot_header header;
+    uint64_t *words;
+    size_t capacity;
+};
+
+struct load_job {
+    struct gol *g;
+    const uint64_t *body;
+    size_t words_per_row;
+};
+
+static inline size_t
+words_per_row(long columns) {
+    return (columns + WORD_BITS - 1) / WORD_BITS;
+}
+
+/* Size of the body compressed, in words. */
+static size_t
+compressed_size(const uint64_t *words, size_t n) {
+    size_t size = 0, i = 0;
+    while (i < n) {
+        while (i < n && !words[i])
+            i++;
+        size += 2;
+        while (i < n && words[i]) {
+            size++;
+            i++;
+        }
+    }
+    return size;
+}
+
+static bool
+write_compressed(FILE *fp, const uint64_t *words, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        uint64_t counts[2] = { 0, 0 };
+        while (i < n && !words[i]) {
+            counts[0]++;
+            i++;
+        }
+        const size_t start = i;
+        while (i < n && words[i])
+            i++;
+        counts[1] = i - start;
+        if (fwrite(counts, sizeof(counts), 1, fp) != 1 ||
+                fwrite(words + start, sizeof(*words), counts[1], fp) !=
+                    counts[1])
+            return false;
+    }
+    return true;
+}
+
+static void
+write_snapshot(struct snapshot_writer *w) {
+    struct snapshot_header *h = &w->header;
+    const size_t n = h->rows * words_per_row(h->columns);
+    const size_t compressed = compressed_size(w->words, n);
+    if (compressed < n)
+        h->flags |= SNAPSHOT_COMPRESSED;
+    h->body_size = sizeof(uint64_t) * (compressed < n ? compressed : n);
+
+    FILE *fp = fopen(w->temp_file, "wb");
+    if (!fp) {
+        fprintf(stderr, "checkpoint: %s\n", strerror(errno));
+        return;
+    }
+    bool ok = fwrite(h, sizeof(*h), 1, fp) == 1;
+    if (ok && h->flags & SNAPSHOT_COMPRESSED)
+        ok = write_compressed(fp, w->words, n);
+    else if (ok)
+        ok = fwrite(w->words, sizeof(*w->words), n, fp) == n;
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fclose(fp) != 0)
+        ok = false;
+    if (!ok || rename(w->temp_file, w->file) == -1) {
+        fprintf(stderr, "checkpoint: %s\n", strerror(errno));
+        remove(w->temp_file);
+    }
+}
+
+static void*
+writer_thread(void *data) {
+    struct snapshot_writer *w = data;
+    pthread_mutex_lock(&w->mutex);
+    while (true) {
+        while (!w->pending && !w->quit)
+            pthread_cond_wait(&w->cond, &w->mutex);
+        if (!w->pending)
+            break;
+        pthread_mutex_unlock(&w->mutex);
+        write_snapshot(w);
+        pthread_mutex_lock(&w->mutex);
+        w->pending = false;
+    }
+    pthread_mutex_unlock(&w->mutex);
+    return NULL;
+}
+
+struct snapshot_writer*
+snapshot_writer_init(const char *file) {
+    struct snapshot_writer *w = malloc(sizeof(*w));
+    if (!w)
+        return NULL;
+    memset(w, 0, sizeof(*w));
+    w->file = malloc(strlen(file) + 1);
+    w->temp_file = malloc(strlen(file) + sizeof(TEMP_SUFFIX));
+    if (!w->file || !w->temp_file)
+        goto error;
+    strcpy(w->file, file);
+    strcpy(w->temp_file, file);
+    strcat(w->temp_file, TEMP_SUFFIX);
+    pthread_mutex_init(&w->mutex, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    if (pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+        pthread_mutex_destroy(&w->mutex);
+        pthread_cond_destroy(&w->cond);
+        goto error;
+    }
+    return w;
+
+    error:
+        free(w->file);
+        free(w->temp_file);
+        free(w);
+        return NULL;
+}
+
+void
+snapshot_writer_free(struct snapshot_writer *w) {
+    if (!w)
+        return;
+    pthread_mutex_lock(&w->mutex);
+    w->quit = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->mutex);
+    pthread_join(w->thread, NULL);
+    pthread_mutex_destroy(&w->mutex);
+    pthread_cond_destroy(&w->cond);
+    free(w->words);
+    free(w->file);
+    free(w->temp_file);
+    free(w);
+}
+
+static void
+copy_table(const struct gol *g, uint64_t *words) {
+    const size_t per_row = words_per_row(g->columns);
+    for (int y = 0; y < g->rows; y++) {
+        uint64_t *row = words + y * per_row;
+        if (g->bits) {
+            memcpy(row, bitgrid_row(g->bits, y), sizeof(*row) * per_row);
+            continue;
+        }
+        memset(row, 0, sizeof(*row) * per_row);
+        const bool *objects = gol_row(g, y);
+        for (int x = 0; x < g->columns; x++)
+            row[x / WORD_BITS] |= (uint64_t) objects[x] << (x % WORD_BITS);
+    }
+}
+
+bool
+snapshot_checkpoint(struct snapshot_writer *w, const struct gol *g) {
+    pthread_mutex_lock(&w->mutex);
+    const bool pending = w->pending;
+    pthread_mutex_unlock(&w->mutex);
+    if (pending)
+        return false;
+
+    // The thread doesn't touch the words until pending is set.
+    const size_t n = g->rows * words_per_row(g->columns);
+    if (n > w->capacity) {
+        free(w->words);
+        w->words = malloc(sizeof(*w->words) * n);
+        if (!w->words) {
+            w->capacity = 0;
+            fprintf(stderr, "checkpoint: memory error\n");
+            return true;
+        }
+        w->capacity = n;
+    }
+    copy_table(g, w->words);
+
+    struct snapshot_header *h = &w->header;
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    h->version = SNAPSHOT_VERSION;
+    h->byte_order = BYTE_ORDER_MARK;
+    h->flags = g->torus ? SNAPSHOT_TORUS : 0;
+    h->rows = g->rows;
+    h->columns = g->columns;
+    h->generation = g->generation;
+    h->seed = g->seed;
+    rule_format(g->rule, h->rule);
+
+    pthread_mutex_lock(&w->mutex);
+    w->pending = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->mutex);
+    return true;
+}
+
+static void
+store_row(const struct load_job *job, int y, const uint64_t *words) {
+    struct gol *g = job->g;
+    if (g->bits) {
+        uint64_t *row = bitgrid_row(g->bits, y);
+        memcpy(row, words, sizeof(*row) * job->words_per_row);
+        row[job->words_per_row - 1] &= g->bits->tail_mask;
+        return;
+    }
+    bool *objects = g->table + (size_t) y * g->columns;
+    for (int x = 0; x < g->columns; x++)
+        objects[x] = (words[x / WORD_BITS] >> (x % WORD_BITS)) & 1;
+}
+
+static void
+load_job(void *data, int worker) {
+    const struct load_job *job = data;
+    int from, to;
+    workers_band(job->g->workers, worker, job->g->rows, &from, &to);
+    for (int y = from; y < to; y++)
+        store_row(job, y, job->body + y * job->words_per_row);
+}
+
+/* Decodes the runs into rows one at a time. */
+static bool
+load_compressed(const struct load_job *job, size_t body_words) {
+    const size_t per_row = job->words_per_row;
+    const size_t n = job->g->rows * per_row;
+    uint64_t *row = calloc(per_row, sizeof(*row));
+    if (!row) {
+        fprintf(stderr, "memory error\n");
+        return false;
+    }
+    const uint64_t *body = job->body, *end = body + body_words;
+    size_t i = 0;
+    bool retval = false;
+    while (i < n) {
+        if (end - body < 2 || body[0] + body[1] == 0 || body[0] > n - i ||
+                body[1] > n - i - body[0] ||
+                (size_t) (end - body - 2) < body[1])
+            goto end;
+        const uint64_t zeros = body[0], literals = body[1];
+        const uint64_t *words = body + 2;
+        body += 2 + literals;
+        for (uint64_t k = 0; k < zeros + literals; k++, i++) {
+            row[i % per_row] = k < zeros ? 0 : words[k - zeros];
+            if (i % per_row == per_row - 1)
+                store_row(job, i / per_row, row);
+        }
+    }
+    retval = body == end;
+
+    end:
+        if (!retval)
+            fprintf(stderr, "corrupt snapshot\n");
+        free(row);
+        return retval;
+}
+
+static bool
+valid_header(const struct snapshot_header *h, size_t size,
+             struct rule *rule) {
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+            h->version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "not a snapshot\n");
+        return false;
+    }
+    if (h->byte_order != BYTE_ORDER_MARK) {
+        fprintf(stderr, "snapshot has a different byte order\n");
+        return false;
+    }
+    char rule_string[SNAPSHOT_RULE_SIZE + 1];
+    memcpy(rule_string, h->rule, SNAPSHOT_RULE_SIZE);
+    rule_string[SNAPSHOT_RULE_SIZE] = '\0';
+    if (!rule_parse(rule_string, rule)) {
+        fprintf(stderr, "unsupported rule: %s\n", rule_string);
+        return false;
+    }
+    if (h->rows <= 0 || h->rows > INT_MAX || h->columns <= 0 ||
+            h->columns > INT_MAX || h->generation < 0 ||
+            h->flags & ~(SNAPSHOT_COMPRESSED | SNAPSHOT_TORUS) ||
+            h->body_size % sizeof(uint64_t) != 0 ||
+            h->body_size > size - sizeof(*h) ||
+            (!(h->flags & SNAPSHOT_COMPRESSED) && h->body_size !=
+                sizeof(uint64_t) * h->rows * words_per_row(h->columns))) {
+        fprintf(stderr, "corrupt snapshot\n");
+        return false;
+    }
+    return true;
+}
+
+static bool
+allocate(struct gol *g, const struct snapshot_header *h, bool bitwise) {
+    g->rows = h->rows;
+    g->columns = h->columns;
+    if (bitwise)
+        g->bits = bitgrid_init(g->rows, g->columns, g->rule, g->torus);
+    else {
+        const size_t objects = (size_t) g->rows * g->columns;
+        g->table = gol_allocate_table(objects);
+        if (g->table)
+            memset(g->table, 0, objects * sizeof(bool));
+    }
+    if (!g->bits && !g->table) {
+        fprintf(stderr, "memory error\n");
+        return false;
+    }
+    return true;
+}
+
+bool
+snapshot_load(const char *file, struct gol *g, bool bitwise,
+              const struct rule *rule) {
+    int fd = open(file, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "Can't open file: %s\n", strerror(errno));
+        return false;
+    }
+    bool retval = false;
+    void *data = MAP_FAILED;
+    struct stat st;
+    size_t size = 0;
+    if (fstat(fd, &st) == -1) {
+        fprintf(stderr, "fstat: %s\n", strerror(errno));
+        goto end;
+    }
+    size = st.st_size;
+    if (size < sizeof(struct snapshot_header)) {
+        fprintf(stderr, "not a snapshot\n");
+        goto end;
+    }
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "mmap: %s\n", strerror(errno));
+        goto end;
+    }
+    madvise(data, size, MADV_WILLNEED);
+
+    const struct snapshot_header *h = data;
+    if (!valid_header(h, size, &g->rule))
+        goto end;
+    if (rule)
+        g->rule = *rule;
+    g->torus = h->flags & SNAPSHOT_TORUS;
+    if (!allocate(g, h, bitwise))
+        goto end;
+    struct load_job job = {
+        .g = g, .body = (const uint64_t*) (h + 1),
+        .words_per_row = words_per_row(h->columns)
+    };
+    if (h->flags & SNAPSHOT_COMPRESSED) {
+        if (!load_compressed(&job, h->body_size / sizeof(uint64_t)))
+            goto end;
+    }
+    else
+        workers_run(g->workers, load_job, &job);
+    if (g->bits)
+        bitgrid_rows_written(g->bits);
+    g->generation = h->generation;
+    g->seed = h->seed;
+    retval = true;
+
+    end:
+        if (data != MAP_FAILED)
+            munmap(data, size);
+        close(fd);
+        return retval;
+}
@@ -0,0 +1,62 @@
+#ifndef SNAPSHOT_H
+    #define SNAPSHOT_H
+#include "gol.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A snapshot is a header followed by the rows of the table, 64 objects to a
+ * word with column x in bit x % 64 of word x / 64, every row starting from
+ * a new word. Words are in the byte order of the machine that wrote them.
+ *
+ * If it makes the body smaller, the body is compressed: runs of zero words
+ * are left out. It's then a sequence of a count of zero words, a count of
+ * literal words and the literal words, until all words are covered.
+ *
+ * SNAPSHOT_TORUS is set in the flags if the edges of the table wrap around. */
+#define SNAPSHOT_MAGIC "GOLSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_COMPRESSED 1
+#define SNAPSHOT_TORUS 2
+#define SNAPSHOT_RULE_SIZE 32
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    // 0x01020304 written natively, to notice a different byte order.
+    uint32_t byte_order;
+    uint32_t flags, reserved;
+    int64_t rows, columns, generation;
+    uint64_t seed;
+    char rule[SNAPSHOT_RULE_SIZE];
+    uint64_t body_size;
+};
+
+/* Writes checkpoints in a thread of its own, so that the game isn't stopped
+ * while a checkpoint is written. */
+struct snapshot_writer;
+
+struct snapshot_writer*
+snapshot_writer_init(const char *file);
+
+/* Waits for the last checkpoint to be written. */
+void
+snapshot_writer_free(struct snapshot_writer *w);
+
+/* Copies the table of g and has it written to a temporary file, which is
+ * renamed over the checkpoint when complete. Returns false if the last
+ * checkpoint is still being written and this one is skipped. Only the bitwise
+ * and scalar engines are supported. */
+bool
+snapshot_checkpoint(struct snapshot_writer *w, const struct gol *g);
+
+/* Maps a snapshot into memory and loads it into the table of g and its
+ * rows, columns, topology, generation, seed and rule, unless another rule is
+ * given.
+ * With bitwise, the rows are copied straight into a bitgrid in g->bits
+ * instead, by the workers of g. Prints an error and returns false on
+ * failure. */
+bool
+snapshot_load(const char *file, struct gol *g, bool bitwise,
+              const struct rule *rule);
+
+#endif // SNAPSHOT_H
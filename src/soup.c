@@ -0,0 +1,40 @@
+#include "soup.h"
+// Bits of the probability, and random numbers drawn per word.
+#define SOUP_PRECISION 16
+#define GOLDEN_GAMMA UINT64_C(0x9E3779B97F4A7C15)
+
+static inline uint64_t
+splitmix64(uint64_t seed, uint64_t counter) {
+    uint64_t z = seed + (counter + 1) * GOLDEN_GAMMA;
+    z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+void
+soup_init(struct soup *s, uint64_t seed, double probability) {
+    s->seed = seed;
+    s->threshold = (uint32_t) (probability * (1 << SOUP_PRECISION) + 0.5);
+}
+
+/* Builds all 64 bits at once from the bits of the probability, least
+ * significant first: a bit that is set ORs in a random word, which adds a
+ * half to the chance of a bit of the word being set, and a bit that isn't
+ * ANDs one in, which halves it. After the last bit, the chance is the
+ * probability. */
+uint64_t
+soup_word(const struct soup *s, uint64_t index) {
+    if (s->threshold >= 1 << SOUP_PRECISION)
+        return ~UINT64_C(0);
+    if (s->threshold == 0)
+        return 0;
+    const uint64_t counter = index * SOUP_PRECISION;
+    // ANDing into zero leaves zero, so start from the lowest bit set.
+    int bit = __builtin_ctz(s->threshold);
+    uint64_t word = splitmix64(s->seed, counter + bit);
+    for (bit++; bit < SOUP_PRECISION; bit++) {
+        const uint64_t r = splitmix64(s->seed, counter + bit);
+        word = s->threshold >> bit & 1 ? word | r : word & r;
+    }
+    return word;
+}
@@ -0,0 +1,24 @@
+#ifndef SOUP_H
+    #define SOUP_H
+#include <stdint.h>
+
+/* Random starting tables that are the same for a seed however many threads
+ * fill them. The generator is SplitMix64 used as a counter-based one: any
+ * number in its sequence is computed from the seed and the index alone, so
+ * every word of 64 objects has numbers of its own, found by its position in
+ * the table, and the words can be filled in any order. */
+struct soup {
+    uint64_t seed;
+    // The probability in fixed point, of 1 << SOUP_PRECISION.
+    uint32_t threshold;
+};
+
+void
+soup_init(struct soup *s, uint64_t seed, double probability);
+
+/* Word number index of the table, each bit of it set with the probability.
+ * Bit n of a word stands for object n of the word. */
+uint64_t
+soup_word(const struct soup *s, uint64_t index);
+
+#endif // SOUP_H
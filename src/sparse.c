@@ -0,0 +1,569 @@
+#include "sparse.h"
+#include "life.h"
+#include "cycle.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#define CHUNK_SIZE 64
+#define INITIAL_SLOTS 1024
+#define NEIGHBORS 8
+
+enum neighbor {
+    NW, N, NE, W, E, SW, S, SE
+};
+
+/* Steps the rows of a chunk from the rows around them, with the ones shifted
+ * by a cell to the left and to the right. */
+typedef void (*chunk_kernel)(const uint64_t*, const uint64_t*,
+                             const uint64_t*, uint64_t*, struct rule);
+
+static const int neighbor_dy[NEIGHBORS] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+static const int neighbor_dx[NEIGHBORS] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+
+struct chunk {
+    long cy, cx;
+    // Index in the array of chunks.
+    size_t index;
+    // Rows of this and the next generation, in turn.
+    uint64_t rows[2][CHUNK_SIZE];
+    // Set while stepping, NULL if there is no such chunk.
+    struct chunk *neighbors[NEIGHBORS];
+    // Whether anything is alive in the next generation.
+    bool alive;
+};
+
+/* Slots of an open addressing hash map with linear probing. */
+struct slot {
+    long cy, cx;
+    // NULL if the slot is free.
+    struct chunk *chunk;
+};
+
+struct sparse {
+    struct slot *slots;
+    size_t capacity;
+    struct chunk **chunks;
+    size_t count, chunks_capacity;
+    // Which of the rows of the chunks are current.
+    int current;
+    struct rule rule;
+    chunk_kernel kernel;
+    // Hash of the cells for finding cycles, kept only after
+    // sparse_track_hash().
+    bool hashing;
+    uint64_t hash;
+};
+
+struct step_job {
+    struct sparse *s;
+    struct workers *w;
+    long *changed;
+    uint64_t *hashes;
+};
+
+static inline long
+floor_div(long a) {
+    return a >= 0 ? a / CHUNK_SIZE : -((-a + CHUNK_SIZE - 1) / CHUNK_SIZE);
+}
+
+static inline size_t
+hash(long cy, long cx) {
+    uint64_t h = (uint64_t) cy * UINT64_C(0x9E3779B97F4A7C15) ^
+                 (uint64_t) cx * UINT64_C(0xC2B2AE3D27D4EB4F);
+    return h ^ (h >> 32);
+}
+
+static inline uint64_t
+row_key(long cy, long cx, int y) {
+    return (uint64_t) hash(cy, cx) * CHUNK_SIZE + y;
+}
+
+static size_t
+find_slot(const struct sparse *s, long cy, long cx) {
+    const size_t mask = s->capacity - 1;
+    size_t i = hash(cy, cx) & mask;
+    while (s->slots[i].chunk &&
+           (s->slots[i].cy != cy || s->slots[i].cx != cx))
+        i = (i + 1) & mask;
+    return i;
+}
+
+static struct chunk*
+find_chunk(const struct sparse *s, long cy, long cx) {
+    return s->slots[find_slot(s, cy, cx)].chunk;
+}
+
+static bool
+grow_slots(struct sparse *s) {
+    struct slot *old = s->slots;
+    const size_t old_capacity = s->capacity;
+    s->slots = calloc(old_capacity * 2, sizeof(*s->slots));
+    if (!s->slots) {
+        s->slots = old;
+        return false;
+    }
+    s->capacity = old_capacity * 2;
+    for (size_t i = 0; i < old_capacity; i++) {
+        if (old[i].chunk)
+            s->slots[find_slot(s, old[i].cy, old[i].cx)] = old[i];
+    }
+    free(old);
+    return true;
+}
+
+static struct chunk*
+add_chunk(struct sparse *s, long cy, long cx) {
+    if ((s->count + 1) * 2 > s->capacity && !grow_slots(s))
+        return NULL;
+    if (s->count == s->chunks_capacity) {
+        size_t capacity = s->chunks_capacity ? s->chunks_capacity * 2 : 64;
+        struct chunk **temp = realloc(s->chunks, sizeof(*temp) * capacity);
+        if (!temp)
+            return NULL;
+        s->chunks = temp;
+        s->chunks_capacity = capacity;
+    }
+    struct chunk *c = calloc(1, sizeof(*c));
+    if (!c)
+        return NULL;
+    c->cy = cy;
+    c->cx = cx;
+    c->index = s->count;
+    s->chunks[s->count++] = c;
+
+    struct slot *slot = &s->slots[find_slot(s, cy, cx)];
+    slot->cy = cy;
+    slot->cx = cx;
+    slot->chunk = c;
+    return c;
+}
+
+/* Removes a chunk and moves the following slots of its probe sequence back,
+ * so no tombstones are needed. */
+static void
+remove_chunk(struct sparse *s, struct chunk *c) {
+    const size_t mask = s->capacity - 1;
+    size_t i = find_slot(s, c->cy, c->cx), j = i;
+    while (true) {
+        j = (j + 1) & mask;
+        if (!s->slots[j].chunk)
+            break;
+        size_t home = hash(s->slots[j].cy, s->slots[j].cx) & mask;
+        // Move the slot unless its home is cyclically between i and j.
+        bool stays = i <= j ? (i < home && home <= j) :
+                              (i < home || home <= j);
+        if (!stays) {
+            s->slots[i] = s->slots[j];
+            i = j;
+        }
+    }
+    s->slots[i].chunk = NULL;
+
+    s->chunks[c->index] = s->chunks[--s->count];
+    s->chunks[c->index]->index = c->index;
+    free(c);
+}
+
+LIFE_INLINE void
+step_rule_rows(uint16_t birth, uint16_t survival, const uint64_t *left,
+               const uint64_t *center, const uint64_t *right,
+               uint64_t *next) {
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        next[y] = life_rule_word(birth, survival,
+            left[y], center[y], right[y],
+            left[y + 1], center[y + 1], right[y + 1],
+            left[y + 2], center[y + 2], right[y + 2]);
+    }
+}
+
+static void
+step_rows_conway(const uint64_t *left, const uint64_t *center,
+                 const uint64_t *right, uint64_t *next, struct rule rule) {
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        next[y] = life_word(left[y], center[y], right[y],
+                            left[y + 1], center[y + 1], right[y + 1],
+                            left[y + 2], center[y + 2], right[y + 2]);
+    }
+}
+
+static void
+step_rows_rule(const uint64_t *left, const uint64_t *center,
+               const uint64_t *right, uint64_t *next, struct rule rule) {
+    step_rule_rows(rule.birth, rule.survival, left, center, right, next);
+}
+
+#define ROWS_KERNEL(name, birth, survival) \
+    static void \
+    step_rows_##name(const uint64_t *left, const uint64_t *center, \
+                     const uint64_t *right, uint64_t *next, \
+                     struct rule rule) { \
+        step_rule_rows(birth, survival, left, center, right, next); \
+    }
+RULE_NAMED(ROWS_KERNEL)
+
+#define KERNELS(name, birth, survival) \
+    { { birth, survival }, step_rows_##name },
+
+// The last kernel is for the rules without kernels of their own.
+static const struct {
+    struct rule rule;
+    chunk_kernel kernel;
+} named_kernels[] = {
+    { { RULE_N(3), RULE_N(2) | RULE_N(3) }, step_rows_conway },
+    RULE_NAMED(KERNELS)
+    { { 0, 0 }, step_rows_rule }
+};
+
+/* Picks the kernel of the rule, the same ones as the bitwise engine has, or
+ * the one looking its tables up at run time if it has none. */
+static chunk_kernel
+select_kernel(struct rule rule) {
+    const size_t last = sizeof(named_kernels) / sizeof(*named_kernels) - 1;
+    size_t i = 0;
+    while (i < last && !rule_equal(rule, named_kernels[i].rule))
+        i++;
+    return named_kernels[i].kernel;
+}
+
+struct sparse*
+sparse_init(struct rule rule) {
+    struct sparse *s = calloc(1, sizeof(*s));
+    if (!s)
+        return NULL;
+    s->rule = rule;
+    s->kernel = select_kernel(rule);
+    s->capacity = INITIAL_SLOTS;
+    s->slots = calloc(s->capacity, sizeof(*s->slots));
+    if (!s->slots) {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void
+sparse_free(struct sparse *s) {
+    if (!s)
+        return;
+    for (size_t i = 0; i < s->count; i++)
+        free(s->chunks[i]);
+    free(s->chunks);
+    free(s->slots);
+    free(s);
+}
+
+bool
+sparse_set(struct sparse *s, long y, long x, bool alive) {
+    const long cy = floor_div(y), cx = floor_div(x);
+    struct chunk *c = find_chunk(s, cy, cx);
+    if (!c) {
+        if (!alive)
+            return true;
+        if (!(c = add_chunk(s, cy, cx)))
+            return false;
+    }
+    const uint64_t bit = UINT64_C(1) << (x - cx * CHUNK_SIZE);
+    uint64_t *row = &c->rows[s->current][y - cy * CHUNK_SIZE];
+    const uint64_t old = *row;
+    if (alive)
+        *row |= bit;
+    else
+        *row &= ~bit;
+    if (s->hashing) {
+        const uint64_t key = row_key(cy, cx, y - cy * CHUNK_SIZE);
+        s->hash ^= cycle_word_hash(key, old) ^ cycle_word_hash(key, *row);
+    }
+    return true;
+}
+
+bool
+sparse_get(const struct sparse *s, long y, long x) {
+    const long cy = floor_div(y), cx = floor_div(x);
+    const struct chunk *c = find_chunk(s, cy, cx);
+    if (!c)
+        return false;
+    return (c->rows[s->current][y - cy * CHUNK_SIZE] >>
+        (x - cx * CHUNK_SIZE)) & 1;
+}
+
+/* Which neighbors cells on the edges of the rows could be born in. */
+static unsigned
+neighbors_needed(const uint64_t *rows) {
+    const uint64_t first = UINT64_C(1), last = UINT64_C(1) << (CHUNK_SIZE - 1);
+    uint64_t any = 0;
+    for (int y = 0; y < CHUNK_SIZE; y++)
+        any |= rows[y];
+
+    unsigned needed = 0;
+    if (rows[0])
+        needed |= 1 << N;
+    if (rows[CHUNK_SIZE - 1])
+        needed |= 1 << S;
+    if (any & first)
+        needed |= 1 << W;
+    if (any & last)
+        needed |= 1 << E;
+    if (rows[0] & first)
+        needed |= 1 << NW;
+    if (rows[0] & last)
+        needed |= 1 << NE;
+    if (rows[CHUNK_SIZE - 1] & first)
+        needed |= 1 << SW;
+    if (rows[CHUNK_SIZE - 1] & last)
+        needed |= 1 << SE;
+    return needed;
+}
+
+/* Adds the empty chunks that cells may be born in and links the neighbors of
+ * every chunk. */
+static bool
+prepare_chunks(struct sparse *s) {
+    const size_t count = s->count;
+    for (size_t i = 0; i < count; i++) {
+        const struct chunk *c = s->chunks[i];
+        const unsigned needed = neighbors_needed(c->rows[s->current]);
+        for (int n = 0; n < NEIGHBORS; n++) {
+            const long cy = c->cy + neighbor_dy[n], cx = c->cx + neighbor_dx[n];
+            if ((needed & (1 << n)) && !find_chunk(s, cy, cx) &&
+                    !add_chunk(s, cy, cx))
+                return false;
+        }
+    }
+    for (size_t i = 0; i < s->count; i++) {
+        struct chunk *c = s->chunks[i];
+        for (int n = 0; n < NEIGHBORS; n++) {
+            c->neighbors[n] = find_chunk(s, c->cy + neighbor_dy[n],
+                c->cx + neighbor_dx[n]);
+        }
+    }
+    return true;
+}
+
+static inline uint64_t
+neighbor_row(const struct chunk *c, int current, int y) {
+    return c ? c->rows[current][y] : 0;
+}
+
+/* Steps a chunk and, unless hash is NULL, moves the rows that changed in and
+ * out of it. */
+static long
+step_chunk(const struct sparse *s, struct chunk *c, uint64_t *hash) {
+    const int current = s->current;
+    struct chunk **nb = c->neighbors;
+    // Rows from one above to one below the chunk, and the same rows of the
+    // chunks to the west and to the east.
+    uint64_t center[CHUNK_SIZE + 2], west[CHUNK_SIZE + 2], east[CHUNK_SIZE + 2];
+    center[0] = neighbor_row(nb[N], current, CHUNK_SIZE - 1);
+    west[0] = neighbor_row(nb[NW], current, CHUNK_SIZE - 1);
+    east[0] = neighbor_row(nb[NE], current, CHUNK_SIZE - 1);
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        center[y + 1] = c->rows[current][y];
+        west[y + 1] = neighbor_row(nb[W], current, y);
+        east[y + 1] = neighbor_row(nb[E], current, y);
+    }
+    center[CHUNK_SIZE + 1] = neighbor_row(nb[S], current, 0);
+    west[CHUNK_SIZE + 1] = neighbor_row(nb[SW], current, 0);
+    east[CHUNK_SIZE + 1] = neighbor_row(nb[SE], current, 0);
+
+    uint64_t left[CHUNK_SIZE + 2], right[CHUNK_SIZE + 2];
+    for (int i = 0; i < CHUNK_SIZE + 2; i++) {
+        left[i] = (center[i] << 1) | (west[i] >> (CHUNK_SIZE - 1));
+        right[i] = (center[i] >> 1) | (east[i] << (CHUNK_SIZE - 1));
+    }
+
+    const uint64_t *rows = c->rows[current];
+    uint64_t *next = c->rows[!current];
+    uint64_t any = 0;
+    long changed = 0;
+    s->kernel(left, center, right, next, s->rule);
+    for (int y = 0; y < CHUNK_SIZE; y++) {
+        any |= next[y];
+        const uint64_t diff = next[y] ^ rows[y];
+        changed += __builtin_popcountll(diff);
+        if (hash && diff) {
+            const uint64_t key = row_key(c->cy, c->cx, y);
+            *hash ^= cycle_word_hash(key, rows[y]) ^
+                cycle_word_hash(key, next[y]);
+        }
+    }
+    c->alive = any != 0;
+    return changed;
+}
+
+static void
+step_job(void *data, int worker) {
+    struct step_job *job = data;
+    int from, to;
+    workers_band(job->w, worker, (int) job->s->count, &from, &to);
+    long changed = 0;
+    uint64_t hash = 0;
+    for (int i = from; i < to; i++) {
+        changed += step_chunk(job->s, job->s->chunks[i],
+            job->s->hashing ? &hash : NULL);
+    }
+    job->changed[worker] = changed;
+    job->hashes[worker] = hash;
+}
+
+/* Returns the cells that changed, or -1 when out of memory. */
+static long
+step_once(struct sparse *s, struct workers *w) {
+    if (!prepare_chunks(s))
+        return -1;
+
+    long counts[workers_count(w)];
+    uint64_t hashes[workers_count(w)];
+    struct step_job job = {
+        .s = s, .w = w, .changed = counts, .hashes = hashes
+    };
+    workers_run(w, step_job, &job);
+
+    s->current = !s->current;
+    for (size_t i = s->count; i-- > 0;) {
+        if (!s->chunks[i]->alive)
+            remove_chunk(s, s->chunks[i]);
+    }
+
+    long changed = 0;
+    for (int i = 0; i < workers_count(w); i++) {
+        changed += counts[i];
+        s->hash ^= hashes[i];
+    }
+    return changed;
+}
+
+long
+sparse_step(struct sparse *s, struct workers *w, long n, bool until_stable,
+            long *changed) {
+    long generation = 0;
+    *changed = 0;
+    while (generation < n) {
+        if ((*changed = step_once(s, w)) < 0)
+            return -1;
+        generation++;
+        if (!*changed && until_stable)
+            break;
+    }
+    return generation;
+}
+
+long
+sparse_population(const struct sparse *s) {
+    long population = 0;
+    for (size_t i = 0; i < s->count; i++) {
+        const uint64_t *rows = s->chunks[i]->rows[s->current];
+        for (int y = 0; y < CHUNK_SIZE; y++)
+            population += __builtin_popcountll(rows[y]);
+    }
+    return population;
+}
+
+/* Counts the cells of a chunk that are in the rectangle from (top, left) to
+ * (bottom, right). */
+static long
+count_chunk(const struct sparse *s, const struct chunk *c, long top,
+            long left, long bottom, long right) {
+    const long y0 = c->cy * CHUNK_SIZE, x0 = c->cx * CHUNK_SIZE;
+    const long from_y = top > y0 ? top - y0 : 0;
+    const long to_y = bottom < y0 + CHUNK_SIZE ? bottom - y0 : CHUNK_SIZE;
+    const long from_x = left > x0 ? left - x0 : 0;
+    const long to_x = right < x0 + CHUNK_SIZE ? right - x0 : CHUNK_SIZE;
+    if (from_y >= to_y || from_x >= to_x)
+        return 0;
+    const uint64_t mask = (~UINT64_C(0) << from_x) &
+        (~UINT64_C(0) >> (CHUNK_SIZE - to_x));
+    long count = 0;
+    for (long y = from_y; y < to_y; y++)
+        count += __builtin_popcountll(c->rows[s->current][y] & mask);
+    return count;
+}
+
+long
+sparse_count(const struct sparse *s, long y, long x, long rows, long columns) {
+    if (rows <= 0 || columns <= 0)
+        return 0;
+    const long top = floor_div(y), bottom = floor_div(y + rows - 1);
+    const long left = floor_div(x), right = floor_div(x + columns - 1);
+    long count = 0;
+    if ((double) (bottom - top + 1) * (right - left + 1) > s->count) {
+        for (size_t i = 0; i < s->count; i++) {
+            count += count_chunk(s, s->chunks[i], y, x, y + rows,
+                x + columns);
+        }
+        return count;
+    }
+    for (long cy = top; cy <= bottom; cy++) {
+        for (long cx = left; cx <= right; cx++) {
+            const struct chunk *c = find_chunk(s, cy, cx);
+            if (c)
+                count += count_chunk(s, c, y, x, y + rows, x + columns);
+        }
+    }
+    return count;
+}
+
+void
+sparse_span(const struct sparse *s, long y, long x, long columns,
+            uint64_t *words) {
+    memset(words, 0, sizeof(*words) * ((columns + 63) / 64));
+    if (columns <= 0)
+        return;
+    const long cy = floor_div(y), row = y - cy * CHUNK_SIZE;
+    const long left = floor_div(x), right = floor_div(x + columns - 1);
+    if (right - left + 1 > (long) s->count) {
+        for (size_t i = 0; i < s->count; i++) {
+            const struct chunk *c = s->chunks[i];
+            if (c->cy == cy && c->cx >= left && c->cx <= right) {
+                life_put_span(words, columns, c->cx * CHUNK_SIZE - x,
+                    c->rows[s->current][row]);
+            }
+        }
+        return;
+    }
+    for (long cx = left; cx <= right; cx++) {
+        const struct chunk *c = find_chunk(s, cy, cx);
+        if (c) {
+            life_put_span(words, columns, cx * CHUNK_SIZE - x,
+                c->rows[s->current][row]);
+        }
+    }
+}
+
+bool
+sparse_bounds(const struct sparse *s, long *top, long *left, long *bottom,
+              long *right) {
+    *top = *left = LONG_MAX;
+    *bottom = *right = LONG_MIN;
+    for (size_t i = 0; i < s->count; i++) {
+        const struct chunk *c = s->chunks[i];
+        const long y0 = c->cy * CHUNK_SIZE, x0 = c->cx * CHUNK_SIZE;
+        if (*top <= y0 && *left <= x0 && y0 + CHUNK_SIZE <= *bottom &&
+                x0 + CHUNK_SIZE <= *right)
+            continue;
+        const uint64_t *rows = c->rows[s->current];
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            if (rows[y])
+                life_bound_word(rows[y], y0 + y, x0, top, left, bottom, right);
+        }
+    }
+    return *top < *bottom;
+}
+
+void
+sparse_track_hash(struct sparse *s) {
+    s->hash = 0;
+    for (size_t i = 0; i < s->count; i++) {
+        const struct chunk *c = s->chunks[i];
+        for (int y = 0; y < CHUNK_SIZE; y++) {
+            s->hash ^= cycle_word_hash(row_key(c->cy, c->cx, y),
+                c->rows[s->current][y]);
+        }
+    }
+    s->hashing = true;
+}
+
+uint64_t
+sparse_hash(const struct sparse *s) {
+    return s->hash;
+}
@@ -0,0 +1,62 @@
+#ifndef SPARSE_H
+    #define SPARSE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "rule.h"
+#include "workers.h"
+
+/* An unbounded universe that keeps only the 64x64 chunks of cells that have
+ * something alive in or next to them, in a hash map keyed by the chunk
+ * coordinates. Chunks are allocated when cells are born in them and freed
+ * when everything in them dies. */
+struct sparse;
+
+/* The rule must not have B0, or nothing would stay empty. */
+struct sparse*
+sparse_init(struct rule rule);
+
+void
+sparse_free(struct sparse *s);
+
+/* Returns false on memory error. */
+bool
+sparse_set(struct sparse *s, long y, long x, bool alive);
+
+bool
+sparse_get(const struct sparse *s, long y, long x);
+
+/* Same as bitgrid_step(), the workers step their share of the chunks.
+ * Returns -1 when out of memory for new chunks. */
+long
+sparse_step(struct sparse *s, struct workers *w, long n, bool until_stable,
+            long *changed);
+
+long
+sparse_population(const struct sparse *s);
+
+/* Counts the alive cells in a rectangle, looking up the chunks in it or going
+ * through all chunks, whichever is fewer. */
+long
+sparse_count(const struct sparse *s, long y, long x, long rows, long columns);
+
+/* Stores the cells of row y from column x on into a span of columns cells,
+ * cell i in bit i % 64 of words[i / 64]. */
+void
+sparse_span(const struct sparse *s, long y, long x, long columns,
+            uint64_t *words);
+
+/* Stores the smallest rectangle holding every alive cell, from (top, left)
+ * to before (bottom, right). Returns false if nothing is alive. */
+bool
+sparse_bounds(const struct sparse *s, long *top, long *left, long *bottom,
+              long *right);
+
+/* Hashes the cells and keeps the hash up to date from then on. */
+void
+sparse_track_hash(struct sparse *s);
+
+uint64_t
+sparse_hash(const struct sparse *s);
+
+#endif // SPARSE_H
@@ -0,0 +1,170 @@
+#include "stats.h"
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+// Latencies of 2^(n - 1) up to 2^n nanoseconds go to bucket n.
+#define BUCKETS 65
+
+struct phase {
+    atomic_uint_fast64_t count, total, max;
+    atomic_uint_fast64_t buckets[BUCKETS];
+};
+
+struct stats {
+    struct phase phases[STATS_PHASES];
+    atomic_uint_fast64_t generations, cells, objects_moved;
+};
+
+static const char *phase_names[STATS_PHASES] = {
+    "step", "checkpoint", "capture", "sleep", "draw", "keys", "wait"
+};
+
+static volatile sig_atomic_t signaled;
+
+struct stats*
+stats_init(void) {
+    struct stats *s = malloc(sizeof(*s));
+    if (!s)
+        return NULL;
+    memset(s, 0, sizeof(*s));
+    return s;
+}
+
+void
+stats_free(struct stats *s) {
+    free(s);
+}
+
+uint64_t
+stats_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/* Every counter has one writer, so it needs no read-modify-write, only to
+ * be read whole by the others. */
+static inline void
+add(atomic_uint_fast64_t *counter, uint64_t n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter,
+        memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static inline uint64_t
+get(const atomic_uint_fast64_t *counter) {
+    return atomic_load_explicit((atomic_uint_fast64_t*) counter,
+        memory_order_relaxed);
+}
+
+void
+stats_time(struct stats *s, enum stats_phase phase, uint64_t start) {
+    const uint64_t ns = stats_now() - start;
+    struct phase *p = &s->phases[phase];
+    add(&p->count, 1);
+    add(&p->total, ns);
+    if (ns > get(&p->max))
+        atomic_store_explicit(&p->max, ns, memory_order_relaxed);
+    add(&p->buckets[ns ? 64 - __builtin_clzll(ns) : 0], 1);
+}
+
+void
+stats_count(struct stats *s, long generations, long long cells,
+            long objects_moved) {
+    add(&s->generations, generations);
+    add(&s->cells, cells);
+    add(&s->objects_moved, objects_moved);
+}
+
+static void
+catch_signal(int signal) {
+    (void) signal;
+    signaled = 1;
+}
+
+bool
+stats_catch_signal(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = catch_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    return sigaction(SIGUSR1, &action, NULL) == 0;
+}
+
+bool
+stats_signaled(void) {
+    if (!signaled)
+        return false;
+    signaled = 0;
+    return true;
+}
+
+/* The upper bound of the bucket the latency at a fraction of the count is
+ * in, so percentiles are at most twice what they really are, and never more
+ * than the maximum. */
+static uint64_t
+percentile(const struct phase *p, uint64_t count, double fraction) {
+    const uint64_t rank = (uint64_t) (fraction * count), max = get(&p->max);
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        seen += get(&p->buckets[b]);
+        if (seen > rank)
+            return b < 64 && UINT64_C(1) << b < max ? UINT64_C(1) << b : max;
+    }
+    return max;
+}
+
+void
+stats_print(const struct stats *s, FILE *fp, long generation,
+            long population) {
+    fprintf(fp, "%-12s %10s %10s %10s %10s %10s %10s\n", "phase", "count",
+        "total s", "mean us", "p50 us", "p99 us", "max us");
+    for (int i = 0; i < STATS_PHASES; i++) {
+        const struct phase *p = &s->phases[i];
+        const uint64_t count = get(&p->count);
+        if (!count)
+            continue;
+        const uint64_t total = get(&p->total);
+        fprintf(fp, "%-12s %10llu %10.3f %10.1f %10.1f %10.1f %10.1f\n",
+            phase_names[i], (unsigned long long) count, total / 1e9,
+            total / 1e3 / count, percentile(p, count, 0.5) / 1e3,
+            percentile(p, count, 0.99) / 1e3, get(&p->max) / 1e3);
+    }
+    fprintf(fp, "generation: %ld\n", generation);
+    fprintf(fp, "generations stepped: %llu\n",
+        (unsigned long long) get(&s->generations));
+    fprintf(fp, "cells stepped: %llu\n", (unsigned long long) get(&s->cells));
+    fprintf(fp, "objects moved: %llu\n",
+        (unsigned long long) get(&s->objects_moved));
+    fprintf(fp, "population: %ld\n", population);
+    fflush(fp);
+}
+
+void
+stats_print_json(const struct stats *s, FILE *fp, long generation,
+                 long population) {
+    fprintf(fp, "{\"generation\":%ld,\"generations\":%llu,\"cells\":%llu,"
+        "\"objects_moved\":%llu,\"population\":%ld,\"phases\":{",
+        generation, (unsigned long long) get(&s->generations),
+        (unsigned long long) get(&s->cells),
+        (unsigned long long) get(&s->objects_moved), population);
+    bool first = true;
+    for (int i = 0; i < STATS_PHASES; i++) {
+        const struct phase *p = &s->phases[i];
+        const uint64_t count = get(&p->count);
+        if (!count)
+            continue;
+        fprintf(fp, "%s\"%s\":{\"count\":%llu,\"total_ns\":%llu,"
+            "\"p50_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu}",
+            first ? "" : ",", phase_names[i], (unsigned long long) count,
+            (unsigned long long) get(&p->total),
+            (unsigned long long) percentile(p, count, 0.5),
+            (unsigned long long) percentile(p, count, 0.99),
+            (unsigned long long) get(&p->max));
+        first = false;
+    }
+    fprintf(fp, "}}\n");
+    fflush(fp);
+}
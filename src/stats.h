@@ -0,0 +1,59 @@
+#ifndef STATS_H
+    #define STATS_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Where the time of a run goes. The stepping thread steps, writes
+ * checkpoints, captures frames and sleeps to keep the rate, and the
+ * interface draws them and waits for keys, or for the next frame on a plain
+ * terminal. Every phase is timed by one thread only, which keeps the count,
+ * the total and a histogram of the latencies in powers of two nanoseconds,
+ * so that any thread can read them while the run goes on. */
+enum stats_phase {
+    STATS_STEP, STATS_CHECKPOINT, STATS_CAPTURE, STATS_SLEEP, STATS_DRAW,
+    STATS_KEYS, STATS_WAIT, STATS_PHASES
+};
+
+struct stats;
+
+struct stats*
+stats_init(void);
+
+void
+stats_free(struct stats *s);
+
+/* Nanoseconds from a monotonic clock. */
+uint64_t
+stats_now(void);
+
+/* Adds the time from start until now to a phase. */
+void
+stats_time(struct stats *s, enum stats_phase phase, uint64_t start);
+
+/* Adds generations stepped in a call of the engine, the cells they stepped
+ * and the objects that moved in the last of them. Called by the stepping
+ * thread only. */
+void
+stats_count(struct stats *s, long generations, long long cells,
+            long objects_moved);
+
+/* Has SIGUSR1 ask for the stats. Returns false if it can't. */
+bool
+stats_catch_signal(void);
+
+/* Whether SIGUSR1 was caught since the last call. */
+bool
+stats_signaled(void);
+
+/* Prints a table of the phases and the counters. */
+void
+stats_print(const struct stats *s, FILE *fp, long generation,
+            long population);
+
+/* Prints the same on one line of JSON. */
+void
+stats_print_json(const struct stats *s, FILE *fp, long generation,
+                 long population);
+
+#endif // STATS_H
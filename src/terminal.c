@@ -0,0 +1,160 @@
+#include "terminal.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wchar.h>
+#define CLEAR "\x1b[2J"
+#define HOME "\x1b[H"
+// "\x1b[ROW;COLUMNH" with two ints.
+#define MOVE_SIZE 24
+
+struct character {
+    char bytes[MB_LEN_MAX];
+    size_t length;
+};
+
+struct terminal {
+    struct character alive, not_alive;
+    char *buf;
+    size_t length, capacity;
+    int rows;
+    bool delta;
+    // The codes of the objects on the terminal, NULL before the first frame.
+    uint8_t *shown;
+    size_t size;
+    // Where the cursor is after the last delta, to leave out moves to the
+    // next column.
+    int y, x;
+};
+
+static bool
+encode(wint_t wc, struct character *c) {
+    mbstate_t state;
+    memset(&state, 0, sizeof(state));
+    c->length = wcrtomb(c->bytes, wc, &state);
+    return c->length != (size_t) -1;
+}
+
+struct terminal*
+terminal_init(const struct gol *g, bool delta) {
+    struct terminal *t = malloc(sizeof(*t));
+    if (!t)
+        return NULL;
+    memset(t, 0, sizeof(*t));
+    if (!encode(g->alive_character, &t->alive) ||
+            !encode(g->not_alive_character, &t->not_alive)) {
+        free(t);
+        return NULL;
+    }
+    const size_t longest = t->alive.length > t->not_alive.length ?
+        t->alive.length : t->not_alive.length;
+    t->capacity = sizeof(CLEAR HOME) +
+        (size_t) g->rows * (g->columns * longest + 1);
+    t->buf = malloc(t->capacity);
+    if (!t->buf) {
+        free(t);
+        return NULL;
+    }
+    t->rows = g->rows;
+    t->size = (size_t) g->rows * g->columns;
+    t->delta = delta;
+    return t;
+}
+
+static void
+flush(struct terminal *t) {
+    size_t written = 0;
+    while (written < t->length) {
+        ssize_t n = write(STDOUT_FILENO, t->buf + written,
+            t->length - written);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            break;
+        written += n;
+    }
+    t->length = 0;
+}
+
+void
+terminal_free(struct terminal *t) {
+    if (!t)
+        return;
+    if (t->shown && t->y != t->rows)
+        t->length = sprintf(t->buf, "\x1b[%d;1H", t->rows + 1);
+    flush(t);
+    free(t->shown);
+    free(t->buf);
+    free(t);
+}
+
+static inline void
+append(struct terminal *t, const char *s, size_t length) {
+    memcpy(t->buf + t->length, s, length);
+    t->length += length;
+}
+
+static inline void
+append_object(struct terminal *t, bool alive) {
+    const struct character *c = alive ? &t->alive : &t->not_alive;
+    if (c->length == 1)
+        t->buf[t->length++] = c->bytes[0];
+    else
+        append(t, c->bytes, c->length);
+}
+
+static void
+draw_frame(struct terminal *t, const struct frame *f) {
+    t->length = 0;
+    if (!t->shown)
+        append(t, CLEAR, sizeof(CLEAR) - 1);
+    append(t, HOME, sizeof(HOME) - 1);
+    const uint8_t *code = f->codes;
+    for (int y = 0; y < f->view.rows; y++) {
+        for (int x = 0; x < f->view.columns; x++)
+            append_object(t, *code++ == FRAME_ALIVE);
+        t->buf[t->length++] = '\n';
+    }
+    // The cursor is left below the table.
+    t->y = f->view.rows;
+    t->x = 0;
+}
+
+/* Appends a move to an object unless the cursor is already there, and the
+ * object. Returns false when the buffer would get longer than a whole frame,
+ * and then the frame is drawn instead. */
+static bool
+draw_changed(struct terminal *t, const struct frame *f) {
+    t->length = 0;
+    for (int y = 0; y < f->view.rows; y++) {
+        for (int x = 0; x < f->view.columns; x++) {
+            const size_t i = (size_t) y * f->view.columns + x;
+            if (f->codes[i] == t->shown[i])
+                continue;
+            if (t->length + MOVE_SIZE + MB_LEN_MAX > t->capacity)
+                return false;
+            if (y != t->y || x != t->x) {
+                t->length += sprintf(t->buf + t->length, "\x1b[%d;%dH",
+                    y + 1, x + 1);
+            }
+            append_object(t, f->codes[i] == FRAME_ALIVE);
+            t->y = y;
+            t->x = x + 1;
+        }
+    }
+    return true;
+}
+
+void
+terminal_draw(struct terminal *t, const struct frame *f) {
+    if (!t->delta || !t->shown || !draw_changed(t, f))
+        draw_frame(t, f);
+    if (!t->shown)
+        t->shown = malloc(t->size);
+    if (t->shown)
+        memcpy(t->shown, f->codes, t->size);
+    flush(t);
+}
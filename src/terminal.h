@@ -0,0 +1,22 @@
+#ifndef TERMINAL_H
+    #define TERMINAL_H
+#include "frame.h"
+#include "gol.h"
+
+/* Draws the table on a plain terminal with ANSI escapes. Every frame is
+ * built in a buffer of its own and written with one write(). */
+struct terminal;
+
+/* With delta, only the objects that changed since the last frame are drawn
+ * after the first one. The frames are of the whole table. */
+struct terminal*
+terminal_init(const struct gol *g, bool delta);
+
+/* Moves the cursor below the table. */
+void
+terminal_free(struct terminal *t);
+
+void
+terminal_draw(struct terminal *t, const struct frame *f);
+
+#endif // TERMINAL_H
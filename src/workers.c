@@ -0,0 +1,148 @@
+#include "workers.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct workers {
+    int threads;
+    pthread_t *ids;
+    // Workers wait on wake until round changes, then run the job.
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    unsigned long round;
+    // Waited on inside a job and once after it.
+    pthread_barrier_t sync;
+    workers_job job;
+    void *data;
+    bool quit;
+};
+
+struct worker_arg {
+    struct workers *w;
+    int worker;
+};
+
+static void*
+worker_main(void *arg) {
+    struct worker_arg a = *(struct worker_arg*) arg;
+    free(arg);
+    unsigned long seen = 0;
+    while (true) {
+        pthread_mutex_lock(&a.w->lock);
+        while (a.w->round == seen)
+            pthread_cond_wait(&a.w->wake, &a.w->lock);
+        seen = a.w->round;
+        bool quit = a.w->quit;
+        pthread_mutex_unlock(&a.w->lock);
+        if (quit)
+            break;
+        a.w->job(a.w->data, a.worker);
+        pthread_barrier_wait(&a.w->sync);
+    }
+    return NULL;
+}
+
+static bool
+start_thread(struct workers *w, int worker) {
+    struct worker_arg *arg = malloc(sizeof(*arg));
+    if (!arg)
+        return false;
+    arg->w = w;
+    arg->worker = worker;
+    if (pthread_create(&w->ids[worker], NULL, worker_main, arg) != 0) {
+        free(arg);
+        return false;
+    }
+    return true;
+}
+
+struct workers*
+workers_init(int threads) {
+    struct workers *w = malloc(sizeof(*w));
+    if (!w)
+        return NULL;
+    memset(w, 0, sizeof(*w));
+    w->threads = 1;
+    if (threads == 1)
+        return w;
+
+    w->ids = malloc(sizeof(*w->ids) * threads);
+    if (!w->ids)
+        goto error;
+    if (pthread_barrier_init(&w->sync, NULL, threads) != 0)
+        goto error;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+
+    for (int i = 1; i < threads; i++) {
+        if (!start_thread(w, i)) {
+            w->threads = i;
+            workers_free(w);
+            return NULL;
+        }
+    }
+    w->threads = threads;
+    return w;
+
+    error:
+        free(w->ids);
+        free(w);
+        return NULL;
+}
+
+static void
+wake_workers(struct workers *w, bool quit) {
+    pthread_mutex_lock(&w->lock);
+    w->quit = quit;
+    w->round++;
+    pthread_cond_broadcast(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+}
+
+void
+workers_free(struct workers *w) {
+    if (!w)
+        return;
+    if (w->ids) {
+        wake_workers(w, true);
+        for (int i = 1; i < w->threads; i++)
+            pthread_join(w->ids[i], NULL);
+        pthread_barrier_destroy(&w->sync);
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->wake);
+        free(w->ids);
+    }
+    free(w);
+}
+
+int
+workers_count(const struct workers *w) {
+    return w->threads;
+}
+
+void
+workers_run(struct workers *w, workers_job job, void *data) {
+    if (w->threads == 1) {
+        job(data, 0);
+        return;
+    }
+    w->job = job;
+    w->data = data;
+    wake_workers(w, false);
+    job(data, 0);
+    pthread_barrier_wait(&w->sync);
+}
+
+void
+workers_sync(struct workers *w) {
+    if (w->threads > 1)
+        pthread_barrier_wait(&w->sync);
+}
+
+void
+workers_band(const struct workers *w, int worker, int rows, int *from,
+             int *to) {
+    *from = (long) rows * worker / w->threads;
+    *to = (long) rows * (worker + 1) / w->threads;
+}
@@ -0,0 +1,32 @@
+#ifndef WORKERS_H
+    #define WORKERS_H
+
+/* A persistent pool of threads. The thread calling workers_run() takes part
+ * as worker 0, so a pool of one thread creates no threads at all. */
+struct workers;
+
+typedef void (*workers_job)(void *data, int worker);
+
+struct workers*
+workers_init(int threads);
+
+void
+workers_free(struct workers *w);
+
+int
+workers_count(const struct workers *w);
+
+/* Calls job on every worker and returns when all of them have returned. */
+void
+workers_run(struct workers *w, workers_job job, void *data);
+
+/* Waits inside a job until every worker has called this. */
+void
+workers_sync(struct workers *w);
+
+/* Splits rows into equal bands and returns the band of a worker. */
+void
+workers_band(const struct workers *w, int worker, int rows, int *from,
+             int *to);
+
+#endif // WORKERS_H
@@ -0,0 +1,103 @@
+#!/bin/sh
+# Checks that the ways of getting to a generation agree, by comparing the
+# checkpoints written at it. Takes the game to run, ./gol by default.
+
+gol=${1:-./gol}
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+# Runs the game with the rest of the arguments and writes the checkpoint of
+# a generation, the last one, to the file of a name.
+snap() {
+    name=$1
+    generation=$2
+    shift 2
+    "$gol" --no-display --checkpoint-every "$generation" \
+        --checkpoint "$dir/$name.snap" "$@" > /dev/null
+}
+
+# Fails the check unless two checkpoints are the same.
+same() {
+    if cmp -s "$dir/$1.snap" "$dir/$2.snap"; then
+        echo "ok: $3"
+    else
+        echo "FAIL: $3"
+        failed=1
+    fi
+}
+
+# Fails the check unless two results are the same and not empty.
+equal() {
+    if [ -n "$1" ] && [ "$1" = "$2" ]; then
+        echo "ok: $3"
+    else
+        echo "FAIL: $3"
+        failed=1
+    fi
+}
+
+# Runs the game with the rest of the arguments and prints the population it
+# ends with.
+population() {
+    "$gol" --no-display "$@" | sed -n 's/^population: //p'
+}
+
+# Replay, seeking to generations after the first keyframe and later ones.
+for topology in bounded torus; do
+    snap record 2500 -r 100 -c 150 -S 1 -T $topology -g 2500 \
+        --record "$dir/run.gol"
+    for seek in 1 1500 2200; do
+        snap replay 2500 --replay "$dir/run.gol" --seek $seek \
+            -g $((2500 - seek))
+        same record replay "replay $topology from $seek"
+    done
+done
+
+# Resuming from a checkpoint halfway.
+for topology in bounded torus; do
+    snap straight 400 -r 100 -c 150 -S 2 -T $topology -g 400
+    snap half 200 -r 100 -c 150 -S 2 -T $topology -g 200
+    snap resumed 400 --resume "$dir/half.snap" -g 200
+    same straight resumed "resume $topology"
+done
+
+# Blocks of generations, on a table of several blocks and tiles.
+for topology in bounded torus; do
+    snap single 300 -r 300 -c 700 -S 3 -T $topology -g 300
+    for block in 2 32; do
+        snap blocks 300 -r 300 -c 700 -S 3 -T $topology -g 300 -B $block
+        same single blocks "block $block $topology"
+    done
+done
+
+# Slabs in processes of their own.
+for topology in bounded torus; do
+    snap one 300 -r 300 -c 200 -S 4 -T $topology -g 300
+    snap two 300 -r 300 -c 200 -S 4 -T $topology -g 300 -m 2
+    same one two "processes 2 $topology"
+done
+
+# A rule other than Conway's on the engines with kernels of their own.
+for topology in bounded torus; do
+    snap scalar 300 -r 200 -c 300 -S 5 -T $topology -g 300 -u B36/S23 \
+        -e scalar
+    snap bitwise 300 -r 200 -c 300 -S 5 -T $topology -g 300 -u B36/S23
+    same scalar bitwise "B36/S23 bitwise $topology"
+done
+
+# The engines without edges against the bitwise one, on an R-pentomino in
+# the middle of a table whose edges its gliders don't reach by then.
+cat > "$dir/r.rle" << 'END'
+x = 1000, y = 1000
+499$500b2o$499b2o$500bo!
+END
+for generations in 100 500 1103; do
+    bitwise=$(population -f "$dir/r.rle" -g $generations)
+    for engine in hashlife sparse; do
+        equal "$bitwise" "$(population -f "$dir/r.rle" -g $generations \
+            -e $engine)" "R-pentomino $engine $generations"
+    done
+done
+
+exit $failed